@@ -5,6 +5,7 @@
 #-------------------------------------------------
 
 QT       -= core gui
+CONFIG   += c++11 thread
 
 TARGET = PxrBeckmann
 TEMPLATE = lib
@@ -35,6 +36,9 @@ SOURCES += \
 
 OTHER_FILES += *.args
 
+# The SoA block kernels rely on the optimiser to vectorise their loops
+unix:QMAKE_CXXFLAGS_RELEASE += -O3 -fno-math-errno -fno-trapping-math
+
 win32:{
     QMAKE_CXXFLAGS += -nologo -MT
     INCLUDEPATH+=C:/boost
@@ -0,0 +1,1133 @@
+//----------------------------------------------------------------------------------------------------------------------
+/// @file PxrBeckmannBench.cpp
+/// @brief Times the block kernels and checks them against the tolerances
+/// they are documented to meet. Only needs the renderer free headers, so it
+/// builds without RMANTREE. Run with a check name (see --list) to run that
+/// check, or without arguments to run them all. A check prints what it
+/// measured next to its tolerance and fails the run if it is exceeded.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include "PxrBeckmannCapture.h"
+#include "PxrBeckmannDispatch.h"
+#include "PxrBeckmannEfficiency.h"
+#include "PxrBeckmannStats.h"
+#include "PxrBeckmannTables.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// Small LCG so every check is repeatable.
+float
+benchRandom(unsigned int &state)
+{
+    state = state * 1664525u + 1013904223u;
+    return (float) (state >> 8) * (1.f / 16777216.f);
+}
+
+// Prints one measurement and whether it is within tolerance.
+bool
+benchReport(char const *what, double value, double tolerance)
+{
+    bool ok = value <= tolerance;
+    printf("  %-40s %12.4g  (<= %g) %s\n", what, value, tolerance,
+           ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Fills every lane of b with a random view, width and mirror blend around
+// N = +z, and its view terms.
+void
+benchRandomBlock(PxrBeckmannSoABlock &b, int samplingMode, int distribution,
+                 unsigned int &state)
+{
+    for (int i = 0; i < k_soaBlockSize; ++i)
+    {
+        float NdV = beckmannMax(benchRandom(state), .001f);
+        float sinV = sqrtf(1.f - NdV*NdV);
+        float phi = 2.f * (float) M_PI * benchRandom(state);
+        float width = .01f + benchRandom(state);
+        b.index[i] = i;
+        b.Nx[i] = 0.f;  b.Ny[i] = 0.f;  b.Nz[i] = 1.f;
+        b.Vx[i] = sinV * cosf(phi); b.Vy[i] = sinV * sinf(phi); b.Vz[i] = NdV;
+        b.TXx[i] = 1.f; b.TXy[i] = 0.f; b.TXz[i] = 0.f;
+        b.TYx[i] = 0.f; b.TYy[i] = 1.f; b.TYz[i] = 0.f;
+        b.NdV[i] = NdV;
+        b.width[i] = width;
+        b.blend[i] = beckmannMin(1.f, 2.f * benchRandom(state));
+        b.xi0[i] = benchRandom(state);
+        b.xi1[i] = benchRandom(state);
+        beckmannViewTerms(samplingMode, NdV, width, b.G1V[i], b.G1ExactV[i],
+                          b.invWidthSqrd[i], b.normD[i], distribution);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief Every lane the kernels keep has finite, non negative outputs, for
+/// every distribution, sampling mode and reverse setting.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkKernels()
+{
+    unsigned int state = 11;
+    int bad = 0;
+    long long kept = 0;
+    for (int k = 0; k < 1024; ++k)
+    {
+        int samplingMode = k & 1;
+        int distribution = (k >> 1) % k_numDistributions;
+        bool reverse = ((k >> 1) / k_numDistributions) & 1;
+        PxrBeckmannSoABlock b;
+        benchRandomBlock(b, samplingMode, distribution, state);
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            if (pass == 0)
+                beckmannGenerateBlock(b, k_soaBlockSize, samplingMode,
+                                      distribution, reverse);
+            else
+                beckmannEvaluateBlock(b, k_soaBlockSize, samplingMode,
+                                      distribution, reverse);
+            for (int i = 0; i < k_soaBlockSize; ++i)
+            {
+                if (!b.valid[i])
+                    continue;
+                ++kept;
+                float out[3] = { b.radiance[i], b.FPdf[i], b.RPdf[i] };
+                for (int j = 0; j < 3; ++j)
+                    bad += beckmannIsNonFinite(out[j]) || out[j] < 0.f;
+            }
+        }
+    }
+    printf("  %lld lanes kept\n", kept);
+    return benchReport("non finite or negative outputs", bad, 0.) && kept > 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief ns per lane of the generate and evaluate kernels for every
+/// distribution and sampling mode, on the baseline kernels and the widest
+/// variant this cpu runs. Only prints, timings are not checked.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkTime()
+{
+    static char const *s_names[k_numDistributions] =
+    {
+        "beckmann", "blinnPhong", "ggx"
+    };
+    const int numBlocks = 4096;
+    int isas[2] = { k_isaBaseline, beckmannSelectIsa() };
+    int sink = 0;
+    printf("  %-10s %-8s %-8s %12s %12s\n", "dist", "mode", "isa",
+           "generate ns", "evaluate ns");
+    for (int d = 0; d < k_numDistributions; ++d)
+    {
+        for (int m = 0; m < 2; ++m)
+        {
+            for (int a = 0; a < (isas[1] == isas[0] ? 1 : 2); ++a)
+            {
+                PxrBeckmannKernelTable const &kernels = beckmannKernelTable(isas[a]);
+                unsigned int state = 5;
+                PxrBeckmannSoABlock b;
+                benchRandomBlock(b, m, d, state);
+                double ns[2];
+                for (int call = 0; call < 2; ++call)
+                {
+                    std::chrono::steady_clock::time_point start =
+                        std::chrono::steady_clock::now();
+                    for (int k = 0; k < numBlocks; ++k)
+                    {
+                        if (call == 0)
+                            kernels.generate(b, k_soaBlockSize, m, d, true);
+                        else
+                            kernels.evaluate(b, k_soaBlockSize, m, d, true);
+                        sink += b.valid[k & (k_soaBlockSize - 1)];
+                    }
+                    ns[call] = std::chrono::duration<double, std::nano>(
+                                   std::chrono::steady_clock::now() - start).count() /
+                               ((double) numBlocks * k_soaBlockSize);
+                }
+                printf("  %-10s %-8s %-8s %12.2f %12.2f\n", s_names[d],
+                       m == k_sampleVisible ? "visible" : "ndf",
+                       beckmannIsaName(isas[a]), ns[0], ns[1]);
+            }
+        }
+    }
+    return sink >= 0;
+}
+
+// Smith G1 of the Beckmann NDF in double precision, as the reference the
+// backends are measured against.
+double
+benchG1(double cosV, double width)
+{
+    if (cosV <= 0.)
+        return 0.;
+    double a = cosV / (width * std::sqrt(std::max(0., 1. - cosV*cosV)));
+    return 2. / (1. + std::erf(a) + std::exp(-a*a) / (a * std::sqrt(M_PI)));
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief Max abs error of every G1 backend against the double precision
+/// Smith term over a (cosV, width) grid, and ns per call of each. Also the
+/// Blinn-Phong G1 against beckmannReferenceG1.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkG1()
+{
+    typedef float (*Backend)(float, float, float);
+    static Backend const s_backends[3] =
+    {
+        beckmannG1Rational, beckmannG1Exact, beckmannG1Table
+    };
+    static char const *s_names[3] =
+    {
+        "rational max abs error", "exact max abs error", "table max abs error"
+    };
+    // PXRBECKMANN_G1_RATIONAL, _EXACT and _TABLE, see PxrBeckmannKernels.h
+    static double const s_tolerances[3] = { 3.2e-3, 1e-6, 1.6e-4 };
+
+    const int numCos = 2000, numWidths = 200;
+    double worst[3] = { 0., 0., 0. };
+    for (int c = 1; c < numCos; ++c)
+    {
+        float cosV = (float) c / numCos;
+        float sinV = sqrtf(1.f - cosV*cosV);
+        for (int w = 0; w < numWidths; ++w)
+        {
+            float width = .01f + 2.f * w / numWidths;
+            double ref = benchG1(cosV, width);
+            for (int k = 0; k < 3; ++k)
+                worst[k] = std::max(worst[k], std::fabs(
+                               s_backends[k](cosV, sinV, width) - ref));
+        }
+    }
+
+    // 1M random pairs per backend
+    const int numCalls = 1 << 20;
+    std::vector<float> cosines(numCalls), sines(numCalls), widths(numCalls);
+    unsigned int state = 17;
+    for (int i = 0; i < numCalls; ++i)
+    {
+        cosines[i] = beckmannMax(benchRandom(state), 1e-3f);
+        sines[i] = sqrtf(1.f - cosines[i] * cosines[i]);
+        widths[i] = .01f + 2.f * benchRandom(state);
+    }
+    float sink = 0.f;
+    for (int k = 0; k < 3; ++k)
+    {
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        for (int i = 0; i < numCalls; ++i)
+            sink += s_backends[k](cosines[i], sines[i], widths[i]);
+        double ns = std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - start).count() / numCalls;
+        printf("  %-40s %12.2f\n", k == 0 ? "rational ns per call" :
+               (k == 1 ? "exact ns per call" : "table ns per call"), ns);
+    }
+
+    // PxrBlinnPhongNdf gives 7e-5 relative, down to grazing
+    double worstBlinnPhong = 0.;
+    for (int c = 0; c < 100; ++c)
+    {
+        float cosV = (c < 40) ? powf(10.f, -3.f + c * .05f) : (c - 39) / 61.f;
+        for (int w = 0; w < 20; ++w)
+        {
+            float width = .02f + 2.f * w / 20;
+            double ref = beckmannReferenceG1(k_distBlinnPhong, cosV, width, true);
+            worstBlinnPhong = std::max(worstBlinnPhong, std::fabs(
+                PxrBlinnPhongNdf::G1(cosV, width) - ref) / ref);
+        }
+    }
+
+    bool ok = sink > 0.f;
+    for (int k = 0; k < 3; ++k)
+        ok &= benchReport(s_names[k], worst[k], s_tolerances[k]);
+    ok &= benchReport("blinn-phong max relative error", worstBlinnPhong, 7e-5);
+    return ok;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief Both sampling modes estimate the same albedo E[W / FPdf] within
+/// Monte Carlo noise, and the pdfs the generate kernel reports for its
+/// directions are the ones the evaluate kernel gives them. The evaluate
+/// kernel rebuilds the half vector from L + V, which costs D a few ulp on
+/// the steep flanks of narrow lobes, so those get the kernels' 5e-4.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkSampling()
+{
+    static const float s_widths[] = { .1f, .3f, .6f, 1.f };
+    static const float s_cosines[] = { .1f, .3f, .6f, .9f };
+    const int numBlocks = 1024;
+    double worstSigma = 0., worstPdf[2] = { 0., 0. };
+    for (int d = 0; d < k_numDistributions; ++d)
+    {
+        if (d == k_distBlinnPhong)
+            continue; // always samples its NDF
+        for (int w = 0; w < 4; ++w)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                double mean[2], variance[2];
+                for (int m = 0; m < 2; ++m)
+                {
+                    PxrBeckmannSoABlock b;
+                    beckmannEfficiencyBlock(b, m, s_widths[w], s_cosines[c], d);
+                    unsigned int state = 1 + 16 * w + c;
+                    double sum = 0., sumSqrd = 0.;
+                    for (int k = 0; k < numBlocks; ++k)
+                    {
+                        for (int i = 0; i < k_soaBlockSize; ++i)
+                        {
+                            b.xi0[i] = benchRandom(state);
+                            b.xi1[i] = benchRandom(state);
+                        }
+                        beckmannGenerateBlock(b, k_soaBlockSize, m, d);
+                        PxrBeckmannSoABlock e = b;
+                        beckmannEvaluateBlock(e, k_soaBlockSize, m, d);
+                        for (int i = 0; i < k_soaBlockSize; ++i)
+                        {
+                            if (!b.valid[i] || b.Lz[i] <= 0.f)
+                                continue;
+                            double f = b.radiance[i] / b.FPdf[i];
+                            sum += f;
+                            sumSqrd += f * f;
+                            float x[2] = { b.FPdf[i], b.RPdf[i] };
+                            float y[2] = { e.FPdf[i], e.RPdf[i] };
+                            for (int j = 0; j < 2; ++j)
+                                worstPdf[w > 0] = std::max(worstPdf[w > 0],
+                                    (double) fabsf(x[j] - y[j]) /
+                                    std::max(1.f, fabsf(x[j])));
+                        }
+                    }
+                    double n = (double) numBlocks * k_soaBlockSize;
+                    mean[m] = sum / n;
+                    variance[m] = std::max(0., sumSqrd / n - mean[m] * mean[m]) / n;
+                }
+                double sigma = std::sqrt(variance[0] + variance[1]);
+                worstSigma = std::max(worstSigma, std::fabs(mean[0] - mean[1]) /
+                                                  std::max(sigma, 1e-6));
+            }
+        }
+    }
+    return benchReport("ndf vs visible albedo, in sigmas", worstSigma, 4.) &
+           benchReport("generate vs evaluate pdf, width .1", worstPdf[0], 5e-4) &
+           benchReport("generate vs evaluate pdf, width >= .3", worstPdf[1], 5e-5);
+}
+
+// Directional albedo of the evaluate kernel by midpoint quadrature over an
+// equal area (cos, phi) grid of the hemisphere.
+double
+benchQuadratureAlbedo(int distribution, float width, float NdV)
+{
+    const int numCos = 512, numPhi = 1024;
+    PxrBeckmannSoABlock b;
+    beckmannEfficiencyBlock(b, k_sampleNdf, width, NdV, distribution);
+    double sum = 0.;
+    int n = 0;
+    for (int c = 0; c < numCos; ++c)
+    {
+        float z = (c + .5f) / numCos;
+        float r = sqrtf(1.f - z*z);
+        for (int p = 0; p < numPhi; ++p)
+        {
+            float phi = 2.f * (float) M_PI * (p + .5f) / numPhi;
+            b.Lx[n] = r * cosf(phi);
+            b.Ly[n] = r * sinf(phi);
+            b.Lz[n] = z;
+            if (++n < k_soaBlockSize)
+                continue;
+            beckmannEvaluateBlock(b, n, k_sampleNdf, distribution);
+            for (int i = 0; i < n; ++i)
+                sum += b.valid[i] ? b.radiance[i] : 0.f;
+            n = 0;
+        }
+    }
+    return sum * 2. * M_PI / ((double) numCos * numPhi);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief The albedo tables against brute force quadrature of the evaluate
+/// kernel, both Integrate at single cells and Lookup between the entries,
+/// and no lobe reflecting more than it receives at wide widths and grazing
+/// views, where the shadowing term matters most.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkAlbedo()
+{
+    static const float s_widths[] = { .15f, .35f, .7f, 1.3f };
+    static const float s_cosines[] = { .15f, .4f, .7f, .95f };
+    // Blinn-Phong's entries sample the NDF, which is noisier
+    double worstIntegrate[2] = { 0., 0. }, worstLookup = 0.;
+    for (int d = 0; d < k_numDistributions; ++d)
+    {
+        double &integrate = worstIntegrate[d == k_distBlinnPhong];
+        PxrBeckmannAlbedoTable table;
+        table.Build(d);
+        for (int w = 0; w < 4; ++w)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                float width = s_widths[w], NdV = s_cosines[c];
+                double ref = benchQuadratureAlbedo(d, width, NdV);
+                integrate = std::max(integrate, std::fabs(
+                    PxrBeckmannAlbedoTable::Integrate(width, NdV, d) - ref));
+                worstLookup = std::max(worstLookup,
+                                       std::fabs(table.Lookup(width, NdV) - ref));
+            }
+        }
+    }
+
+    static const float s_wideWidths[] = { .5f, .75f, 1.f, 1.5f, 2.f };
+    static const float s_grazingCosines[] = { .05f, .1f, .2f };
+    double worstGain = 0.;
+    for (int d = 0; d < k_numDistributions; ++d)
+        for (int w = 0; w < 5; ++w)
+            for (int c = 0; c < 3; ++c)
+                worstGain = std::max(worstGain, benchQuadratureAlbedo(
+                    d, s_wideWidths[w], s_grazingCosines[c]) - 1.);
+
+    return benchReport("Integrate vs quadrature", worstIntegrate[0], 1e-3) &
+           benchReport("blinn-phong Integrate vs quadrature", worstIntegrate[1], 5e-3) &
+           benchReport("Lookup vs quadrature", worstLookup, 5e-3) &
+           benchReport("albedo above 1", worstGain, 0.);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief The view terms the plugin caches per point are the ones each
+/// policy gives directly, and neither kernel writes to them, so reusing
+/// them over many calls gives bit identical results.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkViewTerms()
+{
+    unsigned int state = 23;
+    int mismatches = 0, clobbered = 0, unstable = 0;
+    for (int k = 0; k < 256; ++k)
+    {
+        int samplingMode = k & 1;
+        int distribution = (k >> 1) % k_numDistributions;
+        PxrBeckmannSoABlock b;
+        benchRandomBlock(b, samplingMode, distribution, state);
+        for (int i = 0; i < k_soaBlockSize; ++i)
+        {
+            float NdV = b.NdV[i], width = b.width[i];
+            float G1 = beckmannNdfG1(distribution, NdV, width);
+            float invWidthSqrd = 1.f / (width * width);
+            mismatches += b.G1V[i] != G1 || b.invWidthSqrd[i] != invWidthSqrd;
+        }
+
+        PxrBeckmannSoABlock cached = b;
+        PxrBeckmannSoABlock first = b;
+        beckmannGenerateBlock(first, k_soaBlockSize, samplingMode, distribution);
+        beckmannEvaluateBlock(first, k_soaBlockSize, samplingMode, distribution);
+        PxrBeckmannSoABlock second = first;
+        beckmannGenerateBlock(second, k_soaBlockSize, samplingMode, distribution);
+        beckmannEvaluateBlock(second, k_soaBlockSize, samplingMode, distribution);
+
+        size_t size = sizeof(float) * k_soaBlockSize;
+        clobbered += std::memcmp(first.G1V, cached.G1V, size) ||
+                     std::memcmp(first.G1ExactV, cached.G1ExactV, size) ||
+                     std::memcmp(first.invWidthSqrd, cached.invWidthSqrd, size) ||
+                     std::memcmp(first.normD, cached.normD, size) ||
+                     std::memcmp(first.NdV, cached.NdV, size);
+        unstable += std::memcmp(first.radiance, second.radiance, size) ||
+                    std::memcmp(first.FPdf, second.FPdf, size) ||
+                    std::memcmp(first.RPdf, second.RPdf, size);
+    }
+    return benchReport("view terms differing from the policy", mismatches, 0.) &
+           benchReport("blocks whose view terms a kernel wrote", clobbered, 0.) &
+           benchReport("blocks changing on a second run", unstable, 0.);
+}
+
+// Error of x in units in the last place of the float nearest ref.
+double
+benchUlps(float x, double ref)
+{
+    int e;
+    std::frexp(std::max(std::fabs(ref), (double) FLT_MIN), &e);
+    return std::fabs(x - ref) / std::ldexp(1., e - 24);
+}
+
+// Largest ulps errors of exp and log over the floats whose bit patterns are
+// in [first, last), which covers both signs for exp.
+void
+benchSweepUlps(uint32_t first, uint32_t last, double &expUlps, double &logUlps)
+{
+    expUlps = 0.;
+    logUlps = 0.;
+    for (uint32_t bits = first; bits < last; ++bits)
+    {
+        float x;
+        std::memcpy(&x, &bits, sizeof(x));
+        if (x >= FLT_MIN)
+            logUlps = std::max(logUlps, benchUlps(beckmannLog(x), std::log((double) x)));
+        if (x <= 88.72283f)
+            expUlps = std::max(expUlps, benchUlps(beckmannExp(x), std::exp((double) x)));
+        if (x <= 87.33654f)
+            expUlps = std::max(expUlps, benchUlps(beckmannExp(-x), std::exp(-(double) x)));
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief Errors of the math layer against double precision libm, as
+/// claimed in PxrBeckmannMath.h: exp and log over every float of their
+/// input ranges, split over the hardware threads (a few cpu minutes),
+/// sincos and erf over 10^7 random arguments.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkUlps()
+{
+    // every finite non-negative float, as bit patterns
+    const uint32_t numBits = 0x7f800000u;
+    int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<double> expThread(numThreads), logThread(numThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        uint32_t first = (uint32_t) ((uint64_t) numBits * t / numThreads);
+        uint32_t last = (uint32_t) ((uint64_t) numBits * (t + 1) / numThreads);
+        threads.push_back(std::thread(benchSweepUlps, first, last,
+                                      std::ref(expThread[t]),
+                                      std::ref(logThread[t])));
+    }
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+    double expUlps = *std::max_element(expThread.begin(), expThread.end());
+    double logUlps = *std::max_element(logThread.begin(), logThread.end());
+
+    double sinUlps = 0., sinAbs = 0., erfAbs = 0.;
+    unsigned int state = 29;
+    for (int i = 0; i < 10000000; ++i)
+    {
+        float phi = 2.f * (float) M_PI * benchRandom(state);
+        float s, c;
+        beckmannSincos(phi, s, c);
+        double rs = std::sin((double) phi), rc = std::cos((double) phi);
+        sinAbs = std::max(sinAbs, std::max(std::fabs(s - rs), std::fabs(c - rc)));
+        // away from the zeros, where ulps stop meaning much
+        if (std::fabs(rs) > 1e-3)
+            sinUlps = std::max(sinUlps, benchUlps(s, rs));
+        if (std::fabs(rc) > 1e-3)
+            sinUlps = std::max(sinUlps, benchUlps(c, rc));
+
+        float x = 8.f * benchRandom(state) - 4.f;
+        erfAbs = std::max(erfAbs, std::fabs(beckmannErf(x) - std::erf((double) x)));
+    }
+    // the bounds in PxrBeckmannMath.h
+    return benchReport("exp ulps", expUlps, 1.02) &
+           benchReport("log ulps", logUlps, .83) &
+           benchReport("sincos ulps", sinUlps, 1.52) &
+           benchReport("sincos abs error", sinAbs, 7.8e-8) &
+           benchReport("erf abs error", erfAbs, 2e-7);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief Per-thread counters from several threads merge into the right
+/// totals, and every thread's block starts on its own cache line.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkStats()
+{
+    const int numThreads = 4, numCalls = 10000;
+    PxrBeckmannStats::Reset();
+    std::atomic<int> misaligned(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        threads.push_back(std::thread([&]()
+        {
+            misaligned += ((uintptr_t) &PxrBeckmannStats::Local() & 63) != 0;
+            for (int i = 0; i < numCalls; ++i)
+            {
+                PxrBeckmannStatTally tally;
+                tally.Add(k_statGeneratePoints, 2);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+
+    unsigned long long totals[k_numStats];
+    PxrBeckmannStats::Merge(totals);
+    double expected = 2. * numThreads * numCalls;
+    return benchReport("misaligned thread blocks", misaligned, 0.) &
+           benchReport("generatePoints miscount",
+                       std::fabs(totals[k_statGeneratePoints] - expected), 0.);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief The PXRBECKMANN_TIMING build: percentiles of hand made histograms
+/// are the upper bounds of the buckets holding them, and scoped timers from
+/// several threads land in the bucket of their entry point, grid size and
+/// duration.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkTiming()
+{
+    // 10 calls in [8, 16) ns and 90 in [32, 64) ns
+    unsigned long long histogram[k_timeNsBuckets] = {};
+    histogram[3] = 10;
+    histogram[5] = 90;
+    double percentileErrors = 0.;
+    percentileErrors += beckmannHistogramPercentile(histogram, 100, .05) != 16;
+    percentileErrors += beckmannHistogramPercentile(histogram, 100, .5) != 64;
+    percentileErrors += beckmannHistogramPercentile(histogram, 100, .99) != 64;
+    // one call per bucket, the median is in bucket 16
+    for (int b = 0; b < k_timeNsBuckets; ++b)
+        histogram[b] = 1;
+    percentileErrors += beckmannHistogramPercentile(histogram, k_timeNsBuckets,
+                                                    .5) != 2ull << 16;
+    // past the last bucket, as for an empty histogram
+    percentileErrors += beckmannHistogramPercentile(histogram, k_timeNsBuckets,
+                                                    1.) != 2ull << 31;
+
+    // Every thread times calls of 20us, long enough that the ~20ns of the
+    // clock reads don't move them out of bucket 14, [16384, 32768) ns,
+    // unless the thread is descheduled.
+    const int numThreads = 4, numCalls = 200;
+    const int sizes[] = { 0, 1, 100, 5000 };  // size buckets 0, 0, 6, 11
+    const long long callNs = 20000;
+    PxrBeckmannTiming::Reset();
+    std::atomic<int> misaligned(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            misaligned += ((uintptr_t) &PxrBeckmannTiming::Local() & 63) != 0;
+            for (int i = 0; i < numCalls; ++i)
+            {
+                PxrBeckmannScopedTimer timer(k_timeEvaluate, sizes[t]);
+                std::chrono::steady_clock::time_point start =
+                    std::chrono::steady_clock::now();
+                while (std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start).count() <
+                       callNs)
+                    ;
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+
+    static const int k_size = k_numTimers * k_timeSizeBuckets * k_timeNsBuckets;
+    std::vector<unsigned long long> totals(k_size);
+    PxrBeckmannTiming::Merge(&totals[0]);
+
+    const int expected[k_timeSizeBuckets] =
+        { 2 * numCalls, 0, 0, 0, 0, 0, numCalls, 0, 0, 0, 0, numCalls };
+    double miscounted = 0., tooShort = 0., descheduled = 0., medians = 0.;
+    for (int t = 0; t < k_numTimers; ++t)
+    {
+        for (int s = 0; s < k_timeSizeBuckets; ++s)
+        {
+            unsigned long long const *h = &totals[beckmannTimeBucket(t, s, 0)];
+            unsigned long long calls = 0;
+            for (int b = 0; b < k_timeNsBuckets; ++b)
+            {
+                calls += h[b];
+                // a bucket's upper bound never undercuts the call's length
+                if (h[b] && (2ll << b) <= callNs)
+                    tooShort += h[b];
+                if (b > 14)
+                    descheduled += h[b];
+            }
+            miscounted += std::fabs((double) calls -
+                                    (t == k_timeEvaluate ? expected[s] : 0));
+            if (t == k_timeEvaluate && calls &&
+                beckmannHistogramPercentile(h, calls, .5) != 2ull << 14)
+                medians += 1;
+        }
+    }
+    return benchReport("percentiles off their bucket", percentileErrors, 0.) &
+           benchReport("misaligned thread blocks", misaligned, 0.) &
+           benchReport("calls in the wrong timer or size", miscounted, 0.) &
+           benchReport("calls timed shorter than they took", tooShort, 0.) &
+           benchReport("p50 outside the calls' bucket", medians, 0.) &
+           benchReport("calls descheduled, of 800", descheduled, 400.);
+}
+
+// Splits CSV text into rows of fields, dropping the header.
+std::vector<std::vector<std::string> >
+benchParseCsv(std::string const &text)
+{
+    std::vector<std::vector<std::string> > rows;
+    std::istringstream in(text);
+    std::string line;
+    std::getline(in, line);
+    while (std::getline(in, line))
+    {
+        rows.push_back(std::vector<std::string>());
+        std::istringstream fields(line);
+        std::string field;
+        while (std::getline(fields, field, ','))
+            rows.back().push_back(field);
+    }
+    return rows;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief beckmannEfficiencyCsv writes one well formed row per cell, and its
+/// pdf integrals are 1 for visible normals and 1 - P(V.m <= 0) <= 1 for NDF
+/// sampling, within the noise of the uniform directions they integrate over.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkEfficiency()
+{
+    std::vector<float> widths, cosines;
+    widths.push_back(.3f); widths.push_back(.6f); widths.push_back(1.f);
+    cosines.push_back(.1f); cosines.push_back(.5f); cosines.push_back(.9f);
+    std::ostringstream os;
+    beckmannEfficiencyCsv(os, widths, cosines, 1 << 18);
+    std::vector<std::vector<std::string> > rows = benchParseCsv(os.str());
+
+    double malformed = (rows.size() != 2 * widths.size() * cosines.size());
+    double visibleError = 0., ndfExcess = 0.;
+    for (size_t r = 0; r < rows.size(); ++r)
+    {
+        if (rows[r].size() != 10)
+        {
+            ++malformed;
+            continue;
+        }
+        double pdfIntegral = std::atof(rows[r][4].c_str());
+        double mean = std::atof(rows[r][6].c_str());
+        if (!(mean > 0. && mean <= 1.01)) // an albedo, up to noise
+            ++malformed;
+        if (rows[r][0] == "visible")
+            visibleError = std::max(visibleError, std::fabs(pdfIntegral - 1.));
+        else
+            ndfExcess = std::max(ndfExcess, pdfIntegral - 1.);
+    }
+    return benchReport("malformed rows", malformed, 0.) &
+           benchReport("visible pdf integral - 1", visibleError, .02) &
+           benchReport("ndf pdf integral - 1", ndfExcess, .02);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief beckmannThreadScalingCsv runs 1, 2 and 4 threads and reports a
+/// throughput for each. Scaling itself depends on the machine and is only
+/// printed.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkScaling()
+{
+    std::ostringstream os;
+    beckmannThreadScalingCsv(os, 4, 1 << 18);
+    printf("%s", os.str().c_str());
+    std::vector<std::vector<std::string> > rows = benchParseCsv(os.str());
+
+    static const int s_threads[] = { 1, 2, 4 };
+    double malformed = (rows.size() != 3);
+    for (size_t r = 0; r < rows.size() && r < 3; ++r)
+    {
+        if (rows[r].size() != 3 || std::atoi(rows[r][0].c_str()) != s_threads[r] ||
+            !(std::atof(rows[r][1].c_str()) > 0.))
+            ++malformed;
+    }
+    if (!rows.empty() && rows[0].size() == 3)
+        malformed += std::fabs(std::atof(rows[0][2].c_str()) - 1.) > 1e-6;
+    return benchReport("malformed rows", malformed, 0.);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief beckmannSimplificationCsv writes a row for every distribution,
+/// width and view angle. The simplified lobe carries the tabulated albedo,
+/// so it has to reflect the same energy as the full lobe to within the
+/// table's 5e-3 plus sampling noise. The speedup and the error in the
+/// environment are only printed.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkSimplification()
+{
+    std::vector<float> widths, cosines;
+    widths.push_back(.1f); widths.push_back(.4f); widths.push_back(1.f);
+    cosines.push_back(.2f); cosines.push_back(.5f); cosines.push_back(.9f);
+    std::ostringstream os;
+    beckmannSimplificationCsv(os, widths, cosines, 1 << 16);
+    printf("%s", os.str().c_str());
+    std::vector<std::vector<std::string> > rows = benchParseCsv(os.str());
+
+    double malformed = (rows.size() != k_numDistributions * widths.size() *
+                                       cosines.size());
+    double albedoError = 0.;
+    for (size_t r = 0; r < rows.size(); ++r)
+    {
+        if (rows[r].size() != 11)
+        {
+            ++malformed;
+            continue;
+        }
+        double fullNs = std::atof(rows[r][3].c_str());
+        double simpleNs = std::atof(rows[r][4].c_str());
+        double fullAlbedo = std::atof(rows[r][6].c_str());
+        double simpleAlbedo = std::atof(rows[r][7].c_str());
+        if (!(fullNs > 0. && simpleNs >= 0. && simpleAlbedo > 0. &&
+              simpleAlbedo <= 1.01)) // an albedo, up to noise
+            ++malformed;
+        albedoError = std::max(albedoError, std::fabs(fullAlbedo - simpleAlbedo));
+    }
+    return benchReport("malformed rows", malformed, 0.) &
+           benchReport("albedo difference", albedoError, 1e-2);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief The kernel variants without the reverse pdf write the same
+/// directions, weights, FPdf and masks as the ones with it, bit for bit,
+/// and leave RPdf at 0 on every lane, mirror lanes included.
+/// beckmannReversePdfCsv writes a row for both call types, every
+/// distribution and sampling mode; the saving is only printed.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkReverse()
+{
+    int modes[2] = { k_sampleNdf, k_sampleVisible };
+    unsigned int state = 23;
+    double differences = 0., nonZero = 0.;
+    for (int call = 0; call < 2; ++call)
+    {
+        for (int d = 0; d < k_numDistributions; ++d)
+        {
+            for (int m = 0; m < 2; ++m)
+            {
+                PxrBeckmannSoABlock b[2];
+                benchRandomBlock(b[0], modes[m], d, state);
+                if (call == 1) // evaluate the generated directions
+                    beckmannGenerateBlock(b[0], k_soaBlockSize, modes[m], d);
+                b[1] = b[0];
+                for (int k = 0; k < 2; ++k)
+                {
+                    if (call == 0)
+                        beckmannGenerateBlock(b[k], k_soaBlockSize, modes[m],
+                                              d, k == 0);
+                    else
+                        beckmannEvaluateBlock(b[k], k_soaBlockSize, modes[m],
+                                              d, k == 0);
+                }
+                for (int i = 0; i < k_soaBlockSize; ++i)
+                {
+                    differences += b[0].valid[i] != b[1].valid[i] ||
+                                   b[0].mirror[i] != b[1].mirror[i] ||
+                                   b[0].Lx[i] != b[1].Lx[i] ||
+                                   b[0].Ly[i] != b[1].Ly[i] ||
+                                   b[0].Lz[i] != b[1].Lz[i] ||
+                                   b[0].radiance[i] != b[1].radiance[i] ||
+                                   b[0].FPdf[i] != b[1].FPdf[i];
+                    nonZero += b[1].RPdf[i] != 0.f;
+                }
+            }
+        }
+    }
+
+    std::ostringstream os;
+    beckmannReversePdfCsv(os, 1 << 16);
+    printf("%s", os.str().c_str());
+    std::vector<std::vector<std::string> > rows = benchParseCsv(os.str());
+    double malformed = (rows.size() != 2 * 2 * k_numDistributions);
+    for (size_t r = 0; r < rows.size(); ++r)
+    {
+        if (rows[r].size() != 6 || !(std::atof(rows[r][3].c_str()) > 0.) ||
+            !(std::atof(rows[r][4].c_str()) > 0.))
+            ++malformed;
+    }
+    return benchReport("lanes differing without reverse", differences, 0.) &
+           benchReport("non zero RPdf without reverse", nonZero, 0.) &
+           benchReport("malformed rows", malformed, 0.);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief Writes a capture of every record type, reads it back and replays
+/// it twice. Both replays see every record and lane, time something and
+/// agree on the checksum and the outputs.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkReplay()
+{
+    const char *path = "PxrBeckmannBench.capture";
+    const int numPts = 100;
+    const int numSamples = 70;
+    unsigned int state = 13;
+    std::vector<float> N, T, V, color, width, xi, L;
+    for (int i = 0; i < numPts; ++i)
+    {
+        float NdV = beckmannMax(benchRandom(state), .001f);
+        float sinV = sqrtf(1.f - NdV*NdV);
+        float phi = 2.f * (float) M_PI * benchRandom(state);
+        float n[3] = { 0.f, 0.f, 1.f }, t[3] = { 1.f, 0.f, 0.f };
+        float v[3] = { sinV * cosf(phi), sinV * sinf(phi), NdV };
+        N.insert(N.end(), n, n + 3);
+        T.insert(T.end(), t, t + 3);
+        V.insert(V.end(), v, v + 3);
+        color.insert(color.end(), 3, 1.f);
+        width.push_back(.01f + benchRandom(state));
+        xi.push_back(benchRandom(state));
+        xi.push_back(benchRandom(state));
+        float cosL = benchRandom(state), sinL = sqrtf(1.f - cosL*cosL);
+        phi = 2.f * (float) M_PI * benchRandom(state);
+        L.push_back(sinL * cosf(phi));
+        L.push_back(sinL * sinf(phi));
+        L.push_back(cosL);
+    }
+    {
+        PxrBeckmannCaptureWriter writer(path, 1 << 20);
+        if (!writer.IsOpen())
+            return benchReport("capture not writable", 1., 0.);
+        for (int type = k_captureGenerate; type <= k_captureEvaluateAtIndex; ++type)
+        {
+            int n = (type == k_captureEvaluateAtIndex) ? 1 : numPts;
+            int samples = (type == k_captureGenerate) ? 0 :
+                          (type == k_captureEvaluate) ? numPts : numSamples;
+            PxrBeckmannCaptureWriter::Record r(type, n, samples, 0, k_sampleNdf,
+                                               k_distBeckmann, .001f, .002f);
+            r.Add(&N[0], n, 3);
+            r.Add(&N[0], n, 3);
+            r.Add(&T[0], n, 3);
+            r.Add(&V[0], n, 3);
+            r.Add(&color[0], n, 3);
+            r.Add(&width[0], n, 1);
+            if (type == k_captureGenerate)
+                r.Add(&xi[0], n, 2);
+            else
+                r.Add(&L[0], samples, 3);
+            writer.Write(r);
+        }
+    }
+
+    PxrBeckmannCaptureReader reader;
+    bool opened = reader.Open(path);
+    std::vector<float> outputs[2];
+    PxrBeckmannReplayResult result[2];
+    for (int k = 0; k < 2; ++k)
+        result[k] = beckmannReplay(reader, &outputs[k]);
+    reader.Close();
+    std::remove(path);
+
+    long long lanes = 2 * numPts + numSamples;
+    printf("  %.3g Mlanes/s\n", result[0].lanes / result[0].seconds * 1e-6);
+    bool ok = benchReport("capture not readable", !opened, 0.);
+    for (int k = 0; k < 2; ++k)
+    {
+        ok &= benchReport("records missed", std::abs(3 - result[k].records), 0.);
+        ok &= benchReport("lanes missed", std::abs(lanes - result[k].lanes), 0.);
+        ok &= benchReport("non positive time", !(result[k].seconds > 0.), 0.);
+    }
+    ok &= benchReport("checksum differences", result[0].checksum != result[1].checksum, 0.);
+    ok &= benchReport("output differences", outputs[0] != outputs[1], 0.);
+    return ok;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief Every ISA variant this cpu runs agrees with the baseline kernels
+/// to the 1e-2 that beckmannCompareIsas documents, and no mirror mask
+/// differs.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkIsa()
+{
+    for (int isa = 0; isa < k_numIsas; ++isa)
+        if (beckmannIsaSupported(isa))
+            printf("  %s\n", beckmannIsaName(isa));
+    float worst = beckmannCompareIsas();
+    return benchReport("mirror mask differences", worst < 0.f, 0.) &&
+           benchReport("relative difference", worst, 1e-2);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief The evaluate kernel run the way EvaluateSamplesAtIndex runs it,
+/// one point over every lane, is within the 5e-4 the kernels document of
+/// the scalar beckmannEvaluateReference, and masks the same lights.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkBatched()
+{
+    float worst = beckmannCompareBatchedEvaluate();
+    return benchReport("mask differences", worst < 0.f, 0.) &&
+           benchReport("relative difference", worst, 5e-4);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief beckmannConeAngle holds k_coneFraction of the sampled directions,
+/// at and off normal incidence, to within the .05 that
+/// beckmannCheckConeAngle documents.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkCone()
+{
+    return benchReport("share error", beckmannCheckConeAngle(), .05);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief The table cache round trips: the first Load rebuilds the file
+/// 0600 with the tables beckmannBuildTables makes, later ones map it, and
+/// concurrent Loads of a missing file rebuild it once. Corrupt files,
+/// files others can write and links are refused. The default directory
+/// is private to the user, and attached albedo tables keep no copy.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkTables()
+{
+    double roundTrip = 0., badMapped = 0., concurrent = 0., directory = 0.;
+    double tableBytes = (double) sizeof(PxrBeckmannAlbedoTable);
+#ifndef _WIN32
+    std::string dir = "PxrBeckmannBench.tables";
+    std::string path = dir + "/tables.bin";
+    std::string link = dir + "/link.bin";
+    char userDir[64];
+    snprintf(userDir, sizeof(userDir), "/PxrBeckmann-%u", (unsigned int) geteuid());
+    std::string privateDir = dir + userDir;
+    std::remove(path.c_str());
+    std::remove((path + ".lock").c_str());
+    std::remove(link.c_str());
+    rmdir(privateDir.c_str());
+    mkdir(dir.c_str(), 0700);
+
+    std::vector<float> values;
+    beckmannBuildTables(values);
+    size_t bytes = values.size() * sizeof(float);
+    {
+        PxrBeckmannTables rebuilt, mapped;
+        roundTrip += rebuilt.Load(path.c_str()) != PxrBeckmannTables::k_rebuilt;
+        roundTrip += mapped.Load(path.c_str()) != PxrBeckmannTables::k_mapped;
+        roundTrip += std::memcmp(rebuilt.AlbedoTable(0), &values[0], bytes) != 0;
+        roundTrip += std::memcmp(mapped.AlbedoTable(0), &values[0], bytes) != 0;
+    }
+    struct stat st;
+    roundTrip += stat(path.c_str(), &st) != 0 || (st.st_mode & 0777) != 0600;
+
+    PxrBeckmannTables tables;
+    // a flipped payload byte fails the checksum and is rebuilt
+    FILE *f = fopen(path.c_str(), "r+b");
+    if (f)
+    {
+        fseek(f, sizeof(PxrBeckmannTablesHeader) + 100, SEEK_SET);
+        int c = fgetc(f);
+        fseek(f, sizeof(PxrBeckmannTablesHeader) + 100, SEEK_SET);
+        fputc(c ^ 1, f);
+        fclose(f);
+    }
+    badMapped += !f || tables.Open(path.c_str());
+    roundTrip += tables.Load(path.c_str()) != PxrBeckmannTables::k_rebuilt;
+    tables.Close();
+
+    chmod(path.c_str(), 0622);
+    badMapped += tables.Open(path.c_str());
+    chmod(path.c_str(), 0600);
+    badMapped += symlink("tables.bin", link.c_str()) != 0 || tables.Open(link.c_str());
+
+    // one process rebuilds, the others wait for it and map its file
+    std::remove(path.c_str());
+    std::atomic<int> numRebuilt(0), numMapped(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.push_back(std::thread([&]()
+        {
+            PxrBeckmannTables own;
+            PxrBeckmannTables::Source source = own.Load(path.c_str());
+            numRebuilt += source == PxrBeckmannTables::k_rebuilt;
+            numMapped += source == PxrBeckmannTables::k_mapped;
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+    printf("  concurrent loads: %d rebuilt, %d mapped\n", (int) numRebuilt,
+           (int) numMapped);
+    concurrent = std::abs(numRebuilt - 1) + std::abs(numMapped - 3);
+
+    char const *oldTmp = getenv("TMPDIR");
+    std::string savedTmp = oldTmp ? oldTmp : "";
+    setenv("TMPDIR", dir.c_str(), 1);
+    std::string defaultPath = beckmannDefaultTablesPath();
+    directory += defaultPath.compare(0, privateDir.size(), privateDir) != 0;
+    directory += lstat(privateDir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) ||
+             (st.st_mode & 0777) != 0700 || st.st_uid != geteuid();
+    // a directory others can enter is not used
+    chmod(privateDir.c_str(), 0755);
+    directory += !beckmannDefaultTablesPath().empty();
+    if (oldTmp)
+        setenv("TMPDIR", savedTmp.c_str(), 1);
+    else
+        unsetenv("TMPDIR");
+
+    std::remove(path.c_str());
+    std::remove((path + ".lock").c_str());
+    std::remove(link.c_str());
+    rmdir(privateDir.c_str());
+    rmdir(dir.c_str());
+#endif
+    return benchReport("round trip failures", roundTrip, 0.) &
+           benchReport("bad files mapped", badMapped, 0.) &
+           benchReport("extra or missing rebuilds", concurrent, 0.) &
+           benchReport("default directory failures", directory, 0.) &
+           benchReport("bytes of an attached albedo table", tableBytes, 64.);
+}
+
+struct BenchCheck
+{
+    char const *name;
+    bool (*run)();
+};
+
+BenchCheck const s_checks[] =
+{
+    { "kernels", checkKernels },
+    { "g1", checkG1 },
+    { "sampling", checkSampling },
+    { "albedo", checkAlbedo },
+    { "viewterms", checkViewTerms },
+    { "ulps", checkUlps },
+    { "stats", checkStats },
+    { "timing", checkTiming },
+    { "efficiency", checkEfficiency },
+    { "scaling", checkScaling },
+    { "replay", checkReplay },
+    { "isa", checkIsa },
+    { "batched", checkBatched },
+    { "cone", checkCone },
+    { "simplification", checkSimplification },
+    { "reverse", checkReverse },
+    { "tables", checkTables },
+    { "time", checkTime }
+};
+const int k_numChecks = sizeof(s_checks) / sizeof(s_checks[0]);
+
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+    if (argc > 1 && !std::strcmp(argv[1], "--list"))
+    {
+        for (int c = 0; c < k_numChecks; ++c)
+            printf("%s\n", s_checks[c].name);
+        return 0;
+    }
+
+    int failed = 0, run = 0;
+    for (int c = 0; c < k_numChecks; ++c)
+    {
+        if (argc > 1 && std::strcmp(argv[1], s_checks[c].name))
+            continue;
+        printf("%s\n", s_checks[c].name);
+        ++run;
+        if (!s_checks[c].run())
+            ++failed;
+    }
+    if (!run)
+    {
+        fprintf(stderr, "unknown check %s, see --list\n", argv[1]);
+        return 2;
+    }
+    return failed ? 1 : 0;
+}
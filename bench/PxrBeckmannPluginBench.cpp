@@ -0,0 +1,1202 @@
+//----------------------------------------------------------------------------------------------------------------------
+/// @file PxrBeckmannPluginBench.cpp
+/// @brief Drives the plugin itself through its RIS entry points, built
+/// against the stand-in RIS headers in bench/rix: CreateRixBxdfFactory,
+/// Init, Synchronize, CreateInstanceData, BeginScatter, GenerateSample,
+/// EvaluateSample, EvaluateSamplesAtIndex and EndScatter, on synthetic
+/// shading grids. `time` reports ns, cycles and cache misses per point or
+/// sample of every entry point. The other checks run the plugin the way a
+/// renderer would and hold its outputs to what the kernels promise. Run
+/// with a check name (see --list) and options, or without arguments to run
+/// every check with the default options.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include "RixBxdf.h"
+#include "RixRNG.h"
+#include "PxrBeckmannBsdf.h"
+#include "PxrBeckmannKernels.h"
+#include "PxrBeckmannStats.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define PXRBECKMANN_BENCH_RDTSC
+#endif
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+extern "C" RixBxdfFactory *CreateRixBxdfFactory(const char *hint);
+extern "C" void DestroyRixBxdfFactory(RixBxdfFactory *bxdf);
+
+namespace
+{
+
+// Lobes as the plugin looks them up at RenderBegin
+const RixBXLobeSampled k_blinnLobe(false, 0);
+const RixBXLobeSampled k_mirrorLobe(true, 1);
+
+// Small LCG so every run is repeatable.
+float
+pluginRandom(unsigned int &state)
+{
+    state = state * 1664525u + 1013904223u;
+    return (float) (state >> 8) * (1.f / 16777216.f);
+}
+
+// Prints one measurement and whether it is within tolerance.
+bool
+pluginReport(char const *what, double value, double tolerance)
+{
+    bool ok = value <= tolerance;
+    printf("  %-40s %12.4g  (<= %g) %s\n", what, value, tolerance,
+           ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// A value, or a range values are drawn from uniformly, from "v" or "lo:hi".
+struct PluginRange
+{
+    PluginRange(float v) : lo(v), hi(v) {}
+    PluginRange(float lo_, float hi_) : lo(lo_), hi(hi_) {}
+
+    bool Parse(char const *s)
+    {
+        char *end;
+        lo = hi = strtof(s, &end);
+        if (*end == ':')
+            hi = strtof(end + 1, &end);
+        return !*end && lo <= hi;
+    }
+    bool IsConstant() const { return lo == hi; }
+    float Draw(unsigned int &state) const
+    {
+        return lo + (hi - lo) * pluginRandom(state);
+    }
+
+    float lo, hi;
+};
+
+struct PluginOptions
+{
+    PluginOptions() :
+        numPts(256),
+        numGrids(256),
+        numLights(16),
+        numSamples(8),
+        width(.3f),
+        view(.05f, 1.f),
+        distribution(k_distBeckmann),
+        samplingMode(k_sampleNdf)
+    {
+    }
+
+    int numPts;        // points per grid
+    int numGrids;
+    int numLights;     // samples per EvaluateSamplesAtIndex call
+    int numSamples;    // samples per point of GenerateSamples
+    PluginRange width; // a constant width is an instance parameter, a
+                       // range a network value drawn per point
+    PluginRange view;  // NdV
+    int distribution;
+    int samplingMode;
+};
+
+// One instance of the plugin: the factory from CreateRixBxdfFactory,
+// initialised and synchronised for a render, and an instance built from a
+// parameter list. Parameters are bound by name from the plugin's own table.
+class PluginInstance
+{
+public:
+    explicit PluginInstance(PluginOptions const &options) : m_options(options)
+    {
+        m_ctx.messages.quiet = true;
+        m_factory = CreateRixBxdfFactory("");
+        m_factory->Init(m_ctx, "");
+        m_factory->Synchronize(m_ctx, k_RixSCRenderBegin, NULL);
+
+        RixSCParamInfo const *table = m_factory->GetParamTable();
+        for (m_numParams = 0; table[m_numParams].name; ++m_numParams)
+            ;
+        m_params.resize(m_numParams);
+        Bind("distribution", &m_options.distribution);
+        Bind("samplingMode", &m_options.samplingMode);
+        if (m_options.width.IsConstant())
+            Bind("width", &m_options.width.lo);
+        else
+            m_params[ParamId("width")].info = k_RixSCNetworkValue;
+    }
+
+    ~PluginInstance()
+    {
+        if (m_instance.freefunc)
+            m_instance.freefunc(m_instance.data);
+        m_factory->Synchronize(m_ctx, k_RixSCRenderEnd, NULL);
+        m_factory->Finalize(m_ctx);
+        DestroyRixBxdfFactory(m_factory);
+    }
+
+    int ParamId(char const *name) const
+    {
+        RixSCParamInfo const *table = m_factory->GetParamTable();
+        for (int i = 0; i < m_numParams; ++i)
+        {
+            if (!std::strcmp(table[i].name, name))
+                return i;
+        }
+        fprintf(stderr, "no parameter %s\n", name);
+        exit(1);
+    }
+
+    // Gives a parameter a uniform value, before CreateInstance.
+    template <typename T>
+    void Bind(char const *name, T const *value)
+    {
+        RixParameterBinding &p = m_params[ParamId(name)];
+        p.info = k_RixSCParameter;
+        p.uniform = value;
+    }
+
+    void CreateInstance()
+    {
+        RixParameterList plist(&m_params[0], m_numParams);
+        m_factory->CreateInstanceData(m_ctx, "PxrBeckmannPluginBench", &plist,
+                                      &m_instance);
+    }
+
+    RixBxdfFactory *Factory() { return m_factory; }
+    RtConstPointer InstanceData() const { return m_instance.data; }
+    RixParameterBinding const *Params() const { return &m_params[0]; }
+    int NumParams() const { return m_numParams; }
+    PluginOptions const &Options() const { return m_options; }
+
+private:
+    PluginOptions m_options;
+    RixContext m_ctx;
+    RixBxdfFactory *m_factory;
+    RixBxdfFactory::InstanceData m_instance;
+    std::vector<RixParameterBinding> m_params;
+    int m_numParams;
+};
+
+// The shading context of one grid of random points: normals all over the
+// sphere, views at the NdV of the options, widths drawn per point when the
+// width is a network value.
+class PluginGrid
+{
+public:
+    PluginGrid(PluginInstance const &instance, int numPts, unsigned int seed) :
+        P(numPts), Nn(numPts), Tn(numPts), Vn(numPts), spread(numPts, 0.f),
+        width(numPts)
+    {
+        PluginOptions const &options = instance.Options();
+        unsigned int state = seed;
+        for (int i = 0; i < numPts; ++i)
+        {
+            RtVector3 N = randomDirection(state);
+            RtVector3 A = std::fabs(N.x) < .9f ? RtVector3(1.f, 0.f, 0.f) :
+                                                 RtVector3(0.f, 1.f, 0.f);
+            RtVector3 T = N.Cross(A);
+            T.Normalize();
+            RtVector3 B = N.Cross(T);
+            float NdV = options.view.Draw(state);
+            float sinV = std::sqrt(std::max(0.f, 1.f - NdV*NdV));
+            float phi = 2.f * (float) M_PI * pluginRandom(state);
+            P[i] = RtPoint3((float) i, 0.f, 0.f);
+            Nn[i] = N;
+            Tn[i] = T;
+            Vn[i] = NdV * N + (sinV * std::cos(phi)) * T +
+                    (sinV * std::sin(phi)) * B;
+            width[i] = options.width.Draw(state);
+        }
+
+        sc.numPts = numPts;
+        sc.builtins[RixShadingContext::k_P] = &P[0];
+        sc.builtins[RixShadingContext::k_Nn] = &Nn[0];
+        sc.builtins[RixShadingContext::k_Ngn] = &Nn[0];
+        sc.builtins[RixShadingContext::k_Tn] = &Tn[0];
+        sc.builtins[RixShadingContext::k_Vn] = &Vn[0];
+        sc.builtins[RixShadingContext::k_incidentRaySpread] = &spread[0];
+        params.assign(instance.Params(), instance.Params() + instance.NumParams());
+        params[instance.ParamId("width")].varying = &width[0];
+        sc.params = &params[0];
+        sc.numParams = (int) params.size();
+    }
+
+    // Uniform over the sphere.
+    static RtVector3 randomDirection(unsigned int &state)
+    {
+        float z = 2.f * pluginRandom(state) - 1.f;
+        float r = std::sqrt(std::max(0.f, 1.f - z*z));
+        float phi = 2.f * (float) M_PI * pluginRandom(state);
+        return RtVector3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+    RixShadingContext sc;
+    std::vector<RtPoint3> P;
+    std::vector<RtNormal3> Nn;
+    std::vector<RtVector3> Tn, Vn;
+    std::vector<RtFloat> spread, width;
+    std::vector<RixParameterBinding> params;
+};
+
+// Outputs of the sampling calls for numSamples samples.
+struct PluginSamples
+{
+    explicit PluginSamples(int numSamples) :
+        lobeSampled(numSamples), lobesEvaluated(numSamples), Ln(numSamples),
+        FPdf(numSamples), RPdf(numSamples), compTrans(numSamples),
+        weights(RixBXLobeWeights::k_maxLobes * numSamples),
+        W(numSamples, &weights[0])
+    {
+    }
+
+    std::vector<RixBXLobeSampled> lobeSampled;
+    std::vector<RixBXLobeTraits> lobesEvaluated;
+    std::vector<RtVector3> Ln;
+    std::vector<RtFloat> FPdf, RPdf;
+    std::vector<RtColorRGB> compTrans;
+    std::vector<RtColorRGB> weights;
+    RixBXLobeWeights W;
+};
+
+// ns, cycles and cache misses of the code between Start and Stop, summed
+// over calls. Cycles are the TSC, misses come from perf_event_open and are
+// left out where the kernel doesn't allow it.
+class PluginCounters
+{
+public:
+    PluginCounters() : m_fd(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+    ~PluginCounters()
+    {
+#ifdef __linux__
+        if (m_fd >= 0)
+            close(m_fd);
+#endif
+    }
+
+    bool HaveMisses() const { return m_fd >= 0; }
+    static bool HaveCycles()
+    {
+#ifdef PXRBECKMANN_BENCH_RDTSC
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    struct Totals
+    {
+        Totals() : ns(0.), cycles(0.), misses(0.), count(0) {}
+        double ns, cycles, misses;
+        long long count; // points or samples
+    };
+
+    void Start()
+    {
+        m_misses = misses();
+        m_start = std::chrono::steady_clock::now();
+        m_cycles = cycles();
+    }
+
+    void Stop(Totals &t, long long count)
+    {
+        unsigned long long c = cycles();
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        unsigned long long m = misses();
+        t.ns += std::chrono::duration<double, std::nano>(end - m_start).count();
+        t.cycles += (double) (c - m_cycles);
+        t.misses += (double) (m - m_misses);
+        t.count += count;
+    }
+
+private:
+    static unsigned long long cycles()
+    {
+#ifdef PXRBECKMANN_BENCH_RDTSC
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+    unsigned long long misses() const
+    {
+        unsigned long long value = 0;
+#ifdef __linux__
+        if (m_fd >= 0 && read(m_fd, &value, sizeof(value)) != sizeof(value))
+            value = 0;
+#endif
+        return value;
+    }
+
+    int m_fd;
+    unsigned long long m_misses, m_cycles;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Light directions for EvaluateSample and EvaluateSamplesAtIndex, uniform
+// over the sphere so about half are below the horizon, as for lights
+// sampled without regard to the surface.
+void
+pluginRandomLights(std::vector<RtVector3> &Ln, unsigned int &state)
+{
+    for (size_t i = 0; i < Ln.size(); ++i)
+        Ln[i] = PluginGrid::randomDirection(state);
+}
+
+// True if a valid output is finite and not negative.
+bool
+pluginSane(RtColorRGB const &W, RtFloat FPdf, RtFloat RPdf)
+{
+    float v[5] = { W.r, W.g, W.b, FPdf, RPdf };
+    for (int j = 0; j < 5; ++j)
+    {
+        if (beckmannIsNonFinite(v[j]) || v[j] < 0.f)
+            return false;
+    }
+    return true;
+}
+
+// Red weight over pdf of generated sample o, through whichever lobe it
+// took, the sample's estimate of the point's albedo.
+float
+pluginAlbedoEstimate(PluginSamples const &s, int o)
+{
+    RixBXLobeSampled const &lobe = s.lobeSampled[o];
+    if (!lobe.GetValid())
+        return 0.f;
+    return s.W.GetActiveLobe(lobe.GetDiscrete() ? k_mirrorLobe
+                                                : k_blinnLobe)[o].r / s.FPdf[o];
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief ns, TSC cycles and cache misses per point (BeginScatter) or per
+/// sample (the sampling calls) of every entry point, over --grids grids of
+/// --points points with the --width and --view distributions, and of
+/// GenerateSamples with --samples samples per point. Only prints.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkTime(PluginOptions const &options)
+{
+    PluginInstance instance(options);
+    instance.CreateInstance();
+    RixBxdfFactory *factory = instance.Factory();
+    int numPts = options.numPts, numLights = options.numLights;
+
+    RixBXLobeTraits all = RixBXLobeTraits(k_blinnLobe) |
+                          RixBXLobeTraits(k_mirrorLobe);
+    std::vector<RixBXLobeTraits> lobesWanted(numPts, all);
+    int numSamples = options.numSamples;
+    PluginSamples samples(std::max(numPts, numLights));
+    PluginSamples multi(numPts * numSamples);
+    std::vector<RtVector3> lights(numPts), atIndex(numLights);
+
+    static char const *s_names[] =
+    {
+        "BeginScatter", "GenerateSample", "GenerateSamples",
+        "EvaluateSample", "EvaluateSamplesAtIndex", "EndScatter"
+    };
+    PluginCounters counters;
+    PluginCounters::Totals totals[6];
+    unsigned int state = 3;
+    for (int g = 0; g < options.numGrids; ++g)
+    {
+        PluginGrid grid(instance, numPts, 17 + g);
+        RixRNG rng(numPts, g);
+        pluginRandomLights(lights, state);
+        pluginRandomLights(atIndex, state);
+
+        counters.Start();
+        RixBsdf *bsdf = factory->BeginScatter(&grid.sc, all, k_RixSCScatterQuery,
+                                              instance.InstanceData());
+        counters.Stop(totals[0], numPts);
+
+        samples.W.ClearActiveLobes();
+        counters.Start();
+        bsdf->GenerateSample(k_RixBXAllLighting, &lobesWanted[0], &rng,
+                             &samples.lobeSampled[0], &samples.Ln[0], samples.W,
+                             &samples.FPdf[0], &samples.RPdf[0],
+                             &samples.compTrans[0]);
+        counters.Stop(totals[1], numPts);
+
+        multi.W.ClearActiveLobes();
+        counters.Start();
+        dynamic_cast<PxrBeckmannBsdf *>(bsdf)->GenerateSamples(numSamples,
+            &lobesWanted[0], &rng, &multi.lobeSampled[0], &multi.Ln[0],
+            multi.W, &multi.FPdf[0], &multi.RPdf[0]);
+        counters.Stop(totals[2], (long long) numPts * numSamples);
+
+        samples.W.ClearActiveLobes();
+        counters.Start();
+        bsdf->EvaluateSample(k_RixBXDirectLighting, &lobesWanted[0], &rng,
+                             &samples.lobesEvaluated[0], &lights[0], samples.W,
+                             &samples.FPdf[0], &samples.RPdf[0]);
+        counters.Stop(totals[3], numPts);
+
+        counters.Start();
+        for (int i = 0; i < numPts; ++i)
+        {
+            samples.W.ClearActiveLobes();
+            bsdf->EvaluateSamplesAtIndex(k_RixBXDirectLighting, all, &rng, i,
+                                         numLights, &samples.lobesEvaluated[0],
+                                         &atIndex[0], samples.W,
+                                         &samples.FPdf[0], &samples.RPdf[0]);
+        }
+        counters.Stop(totals[4], (long long) numPts * numLights);
+
+        counters.Start();
+        factory->EndScatter(bsdf);
+        grid.sc.Release();
+        counters.Stop(totals[5], numPts);
+    }
+
+    printf("  %d grids of %d points, %d lights and %d samples per point, "
+           "width %g:%g, NdV %g:%g\n", options.numGrids, numPts, numLights,
+           numSamples,
+           options.width.lo, options.width.hi, options.view.lo, options.view.hi);
+    printf("  %-24s %12s %12s %12s %12s\n", "entry point", "per", "ns",
+           "cycles", "misses");
+    for (int t = 0; t < 6; ++t)
+    {
+        double n = (double) std::max(totals[t].count, 1ll);
+        char cycles[32] = "n/a", misses[32] = "n/a";
+        if (PluginCounters::HaveCycles())
+            snprintf(cycles, sizeof(cycles), "%.1f", totals[t].cycles / n);
+        if (counters.HaveMisses())
+            snprintf(misses, sizeof(misses), "%.3f", totals[t].misses / n);
+        printf("  %-24s %12s %12.2f %12s %12s\n", s_names[t],
+               (t == 0 || t == 5) ? "point" : "sample",
+               totals[t].ns / n, cycles, misses);
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief Every entry point, for every distribution, sampling mode and
+/// constant or varying width, returns finite, non negative weights and pdfs,
+/// and evaluating the lobe in a direction GenerateSample picked from it
+/// gives back the weight and pdfs it was generated with.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkEntryPoints(PluginOptions const &defaults)
+{
+    double bad = 0., mismatched = 0.;
+    long long generated = 0, evaluated = 0;
+    for (int k = 0; k < 2 * 2 * k_numDistributions; ++k)
+    {
+        PluginOptions options = defaults;
+        options.samplingMode = k & 1;
+        options.width = ((k >> 1) & 1) ? PluginRange(.3f) :
+                                         PluginRange(.01f, .8f);
+        options.distribution = k >> 2;
+        PluginInstance instance(options);
+        instance.CreateInstance();
+        RixBxdfFactory *factory = instance.Factory();
+
+        int numPts = 512;
+        RixBXLobeTraits all = RixBXLobeTraits(k_blinnLobe) |
+                              RixBXLobeTraits(k_mirrorLobe);
+        std::vector<RixBXLobeTraits> lobesWanted(numPts, all);
+        PluginGrid grid(instance, numPts, 7 + k);
+        RixRNG rng(numPts, k);
+        RixBsdf *bsdf = factory->BeginScatter(&grid.sc, all, k_RixSCScatterQuery,
+                                              instance.InstanceData());
+
+        PluginSamples gen(numPts), eval(numPts);
+        bsdf->GenerateSample(k_RixBXAllLighting, &lobesWanted[0], &rng,
+                             &gen.lobeSampled[0], &gen.Ln[0], gen.W,
+                             &gen.FPdf[0], &gen.RPdf[0], &gen.compTrans[0]);
+        bsdf->EvaluateSample(k_RixBXAllLighting, &lobesWanted[0], &rng,
+                             &eval.lobesEvaluated[0], &gen.Ln[0], eval.W,
+                             &eval.FPdf[0], &eval.RPdf[0]);
+        RtColorRGB const *genW = gen.W.GetActiveLobe(k_blinnLobe);
+        RtColorRGB const *evalW = eval.W.GetActiveLobe(k_blinnLobe);
+        for (int i = 0; i < numPts; ++i)
+        {
+            RixBXLobeSampled const &lobe = gen.lobeSampled[i];
+            if (!lobe.GetValid() || lobe.GetDiscrete())
+                continue;
+            ++generated;
+            bad += !pluginSane(genW[i], gen.FPdf[i], gen.RPdf[i]);
+            // below the horizon the lobe is 0 and EvaluateSample skips it
+            if (!eval.lobesEvaluated[i].HasAny())
+            {
+                mismatched += genW[i].r > 0.f;
+                continue;
+            }
+            ++evaluated;
+            bad += !pluginSane(evalW[i], eval.FPdf[i], eval.RPdf[i]);
+            float outputs[3][2] =
+            {
+                { genW[i].r, evalW[i].r },
+                { gen.FPdf[i], eval.FPdf[i] },
+                { gen.RPdf[i], eval.RPdf[i] }
+            };
+            // Evaluate rebuilds the half vector from L + V, which moves D
+            // of the narrowest lobes, where it is badly conditioned, by up
+            // to ~5e-3, as between the ISA variants.
+            for (int j = 0; j < 3; ++j)
+            {
+                float a = outputs[j][0], b = outputs[j][1];
+                mismatched += std::fabs(a - b) > 1e-2f * std::max(1.f, std::fabs(a));
+            }
+        }
+
+        std::vector<RtVector3> lights(16);
+        unsigned int state = 41 + k;
+        pluginRandomLights(lights, state);
+        PluginSamples at(16);
+        for (int i = 0; i < numPts; ++i)
+        {
+            at.W.ClearActiveLobes();
+            bsdf->EvaluateSamplesAtIndex(k_RixBXAllLighting, all, &rng, i, 16,
+                                         &at.lobesEvaluated[0], &lights[0],
+                                         at.W, &at.FPdf[0], &at.RPdf[0]);
+            RtColorRGB const *atW = at.W.GetActiveLobe(k_blinnLobe);
+            for (int s = 0; s < 16; ++s)
+            {
+                if (at.lobesEvaluated[s].HasAny())
+                    bad += !pluginSane(atW[s], at.FPdf[s], at.RPdf[s]);
+            }
+        }
+        factory->EndScatter(bsdf);
+    }
+    printf("  %lld microfacet samples generated, %lld evaluated back\n",
+           generated, evaluated);
+    return pluginReport("non finite or negative outputs", bad, 0.) &
+           pluginReport("evaluations differing from generate", mismatched, 0.) &
+           (evaluated > generated / 2);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief GenerateSample only returns samples of the lobes each point asked
+/// for. Widths in the mirror band give points both lobes; asking for one of
+/// them returns exactly the samples of that lobe that asking for both does,
+/// and adds no weights for the other.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkLobes(PluginOptions const &defaults)
+{
+    PluginOptions options = defaults;
+    options.width = PluginRange(.0075f); // blend .5 with the default band
+    PluginInstance instance(options);
+    instance.CreateInstance();
+    RixBxdfFactory *factory = instance.Factory();
+    int numPts = 1024;
+
+    RixBXLobeTraits blinn(k_blinnLobe), mirror(k_mirrorLobe);
+    RixBXLobeTraits wants[3] = { blinn | mirror, blinn, mirror };
+    double wrongLobe = 0., unwantedWeights = 0., differing = 0.;
+    int counts[2] = { 0, 0 };
+    std::vector<RixBXLobeSampled> bothLobe;
+    std::vector<RtVector3> bothLn;
+    for (int w = 0; w < 3; ++w)
+    {
+        // the same grid and rng every time
+        PluginGrid grid(instance, numPts, 5);
+        RixRNG rng(numPts, 9);
+        std::vector<RixBXLobeTraits> lobesWanted(numPts, wants[w]);
+        // one point wanting both takes the per point path of activePoints
+        lobesWanted[0] = wants[0];
+        RixBsdf *bsdf = factory->BeginScatter(&grid.sc, wants[0],
+                                              k_RixSCScatterQuery,
+                                              instance.InstanceData());
+        PluginSamples gen(numPts);
+        bsdf->GenerateSample(k_RixBXAllLighting, &lobesWanted[0], &rng,
+                             &gen.lobeSampled[0], &gen.Ln[0], gen.W,
+                             &gen.FPdf[0], &gen.RPdf[0], &gen.compTrans[0]);
+        if (w == 0)
+        {
+            bothLobe = gen.lobeSampled;
+            bothLn = gen.Ln;
+        }
+        for (int i = 0; i < numPts; ++i)
+        {
+            RixBXLobeSampled const &lobe = gen.lobeSampled[i];
+            if (lobe.GetValid())
+                wrongLobe += !(lobesWanted[i] & RixBXLobeTraits(lobe)).HasAny();
+            if (w == 0)
+            {
+                counts[lobe.GetDiscrete()] += lobe.GetValid();
+                continue;
+            }
+            // the sample asking for both gives, if it is of a wanted lobe
+            RixBXLobeSampled const &expected = bothLobe[i];
+            bool keep = expected.GetValid() &&
+                        (lobesWanted[i] & RixBXLobeTraits(expected)).HasAny();
+            if (keep != lobe.GetValid())
+                differing += 1;
+            else if (keep && (lobe.GetDiscrete() != expected.GetDiscrete() ||
+                              gen.Ln[i].x != bothLn[i].x ||
+                              gen.Ln[i].y != bothLn[i].y ||
+                              gen.Ln[i].z != bothLn[i].z))
+                differing += 1;
+        }
+        factory->EndScatter(bsdf);
+    }
+    // Weights are added for any lobe some point wants, so only a grid where
+    // none wants it must leave it out
+    for (int w = 1; w < 3; ++w)
+    {
+        PluginGrid grid(instance, numPts, 5);
+        RixRNG rng(numPts, 9);
+        std::vector<RixBXLobeTraits> lobesWanted(numPts, wants[w]);
+        RixBsdf *bsdf = factory->BeginScatter(&grid.sc, wants[w],
+                                              k_RixSCScatterQuery,
+                                              instance.InstanceData());
+        PluginSamples gen(numPts);
+        bsdf->GenerateSample(k_RixBXAllLighting, &lobesWanted[0], &rng,
+                             &gen.lobeSampled[0], &gen.Ln[0], gen.W,
+                             &gen.FPdf[0], &gen.RPdf[0], &gen.compTrans[0]);
+        RixBXLobeSampled unwanted = (w == 1) ? k_mirrorLobe : k_blinnLobe;
+        unwantedWeights += gen.W.GetActiveLobe(unwanted) != NULL;
+        factory->EndScatter(bsdf);
+    }
+    printf("  both lobes: %d microfacet, %d mirror samples\n",
+           counts[0], counts[1]);
+    return pluginReport("samples of lobes not asked for", wrongLobe, 0.) &
+           pluginReport("weights added for lobes not asked for",
+                        unwantedWeights, 0.) &
+           pluginReport("samples differing from asking for both",
+                        differing, 0.) &
+           (counts[0] > 0 && counts[1] > 0);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief GenerateSamples(K) returns what K GenerateSample calls return when
+/// they are handed the lattice samples of the same shift, bit for bit, and
+/// its stratified samples estimate each point's albedo with less error than
+/// K independent GenerateSample calls do.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkSamples(PluginOptions const &defaults)
+{
+    int numPts = 256, numSamples = defaults.numSamples, numRef = 1024;
+    double differing = 0., errStratified = 0., errIndependent = 0.;
+    for (int k = 0; k < 2 * k_numDistributions; ++k)
+    {
+        PluginOptions options = defaults;
+        options.distribution = k % k_numDistributions;
+        options.samplingMode = (k / k_numDistributions) ? k_sampleVisible
+                                                        : k_sampleNdf;
+        // through the mirror band into rough lobes
+        options.width = PluginRange(.003f, .6f);
+        PluginInstance instance(options);
+        instance.CreateInstance();
+        RixBxdfFactory *factory = instance.Factory();
+        RixBXLobeTraits all = RixBXLobeTraits(k_blinnLobe) |
+                              RixBXLobeTraits(k_mirrorLobe);
+        std::vector<RixBXLobeTraits> lobesWanted(numPts, all);
+        PluginGrid grid(instance, numPts, 31 + k);
+        RixBsdf *bsdf = factory->BeginScatter(&grid.sc, all,
+                                              k_RixSCScatterQuery,
+                                              instance.InstanceData());
+        PxrBeckmannBsdf *beckmann = dynamic_cast<PxrBeckmannBsdf *>(bsdf);
+        if (!beckmann)
+        {
+            printf("  BeginScatter did not return a PxrBeckmannBsdf\n");
+            return false;
+        }
+
+        PluginSamples ref(numPts * numRef);
+        RixRNG refRng(numPts, 100 + k);
+        beckmann->GenerateSamples(numRef, &lobesWanted[0], &refRng,
+                                  &ref.lobeSampled[0], &ref.Ln[0], ref.W,
+                                  &ref.FPdf[0], &ref.RPdf[0]);
+
+        PluginSamples multi(numPts * numSamples);
+        RixRNG rng(numPts, 200 + k), shiftRng(numPts, 200 + k);
+        beckmann->GenerateSamples(numSamples, &lobesWanted[0], &rng,
+                                  &multi.lobeSampled[0], &multi.Ln[0], multi.W,
+                                  &multi.FPdf[0], &multi.RPdf[0]);
+        std::vector<RtFloat2> shift(numPts), xi(numPts);
+        shiftRng.DrawSamples2D(numPts, &shift[0]);
+
+        std::vector<double> albedo(numPts, 0.), stratified(numPts, 0.),
+                            independent(numPts, 0.);
+        for (int r = 0; r < numRef; ++r)
+        {
+            for (int i = 0; i < numPts; ++i)
+                albedo[i] += pluginAlbedoEstimate(ref, r * numPts + i) / numRef;
+        }
+        for (int s = 0; s < numSamples; ++s)
+        {
+            // sample s of the lattice, and an independent sample
+            PluginSamples single(numPts), random(numPts);
+            for (int i = 0; i < numPts; ++i)
+                beckmannLatticeSample(s, numSamples, shift[i].x, shift[i].y,
+                                      xi[i].x, xi[i].y);
+            rng.SetNext2D(&xi[0]);
+            bsdf->GenerateSample(k_RixBXAllLighting, &lobesWanted[0], &rng,
+                                 &single.lobeSampled[0], &single.Ln[0],
+                                 single.W, &single.FPdf[0], &single.RPdf[0],
+                                 &single.compTrans[0]);
+            bsdf->GenerateSample(k_RixBXAllLighting, &lobesWanted[0], &rng,
+                                 &random.lobeSampled[0], &random.Ln[0],
+                                 random.W, &random.FPdf[0], &random.RPdf[0],
+                                 &random.compTrans[0]);
+            for (int i = 0; i < numPts; ++i)
+            {
+                int o = s * numPts + i;
+                RixBXLobeSampled const &a = single.lobeSampled[i];
+                RixBXLobeSampled const &b = multi.lobeSampled[o];
+                float wa = pluginAlbedoEstimate(single, i);
+                float wb = pluginAlbedoEstimate(multi, o);
+                if (a.GetValid() != b.GetValid())
+                    differing += 1;
+                else if (a.GetValid() &&
+                         (a.GetDiscrete() != b.GetDiscrete() || wa != wb ||
+                          single.Ln[i].x != multi.Ln[o].x ||
+                          single.Ln[i].y != multi.Ln[o].y ||
+                          single.Ln[i].z != multi.Ln[o].z ||
+                          single.FPdf[i] != multi.FPdf[o] ||
+                          single.RPdf[i] != multi.RPdf[o]))
+                    differing += 1;
+                stratified[i] += wb / numSamples;
+                independent[i] += pluginAlbedoEstimate(random, i) / numSamples;
+            }
+        }
+        for (int i = 0; i < numPts; ++i)
+        {
+            errStratified += (stratified[i] - albedo[i]) *
+                             (stratified[i] - albedo[i]);
+            errIndependent += (independent[i] - albedo[i]) *
+                              (independent[i] - albedo[i]);
+        }
+        factory->EndScatter(bsdf);
+        grid.sc.Release();
+    }
+    printf("  %d samples per point: squared albedo error %.4g stratified, "
+           "%.4g independent\n", numSamples, errStratified, errIndependent);
+    return pluginReport("samples differing from GenerateSample", differing,
+                        0.) &
+           pluginReport("stratified / independent squared error",
+                        errStratified / std::max(errIndependent, 1e-30), .5);
+}
+
+// Outputs of numLights EvaluateSample calls over a grid, light l's at
+// l * numPts with a W of its own.
+struct PluginLightOutputs
+{
+    PluginLightOutputs(int numPts_, int numLights) :
+        numPts(numPts_), samples(numPts_ * numLights)
+    {
+        for (int l = 0; l < numLights; ++l)
+            W.push_back(RixBXLobeWeights(numPts, &samples.weights[0] +
+                RixBXLobeWeights::k_maxLobes * numPts * l));
+    }
+
+    void Evaluate(RixBsdf *bsdf, int l, RixBXLobeTraits const *lobesWanted,
+                  RixRNG *rng, RtVector3 const *lights)
+    {
+        int o = l * numPts;
+        W[l].ClearActiveLobes();
+        bsdf->EvaluateSample(k_RixBXDirectLighting, lobesWanted, rng,
+                             &samples.lobesEvaluated[o], &lights[o], W[l],
+                             &samples.FPdf[o], &samples.RPdf[o]);
+    }
+
+    // Points of light l evaluated differently by the two.
+    int Differing(PluginLightOutputs const &other, int l) const
+    {
+        RtColorRGB const *a = W[l].GetActiveLobe(k_blinnLobe);
+        RtColorRGB const *b = other.W[l].GetActiveLobe(k_blinnLobe);
+        if (!a || !b)
+            return (!a != !b) * numPts;
+        int differing = 0;
+        for (int i = 0, o = l * numPts; i < numPts; ++i, ++o)
+        {
+            bool evaluated = samples.lobesEvaluated[o].HasAny();
+            if (evaluated != other.samples.lobesEvaluated[o].HasAny())
+                ++differing;
+            else if (evaluated)
+                differing += a[i].r != b[i].r || a[i].g != b[i].g ||
+                             a[i].b != b[i].b ||
+                             samples.FPdf[o] != other.samples.FPdf[o] ||
+                             samples.RPdf[o] != other.samples.RPdf[o];
+        }
+        return differing;
+    }
+
+    int numPts;
+    PluginSamples samples;
+    std::vector<RixBXLobeWeights> W;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief What caching the view terms across calls saves: for 1 to 64
+/// light samples per point, ns per sample of L EvaluateSample calls on one
+/// BeginScatter, which computes the view terms once, against a BeginScatter
+/// and EndScatter around every call, which computes them every time. The
+/// latter also pays for the two calls themselves, printed on their own.
+/// Both give bit identical outputs; the timings are only printed.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkViewCache(PluginOptions const &options)
+{
+    PluginInstance instance(options);
+    instance.CreateInstance();
+    RixBxdfFactory *factory = instance.Factory();
+    int numPts = options.numPts, maxLights = 64;
+
+    RixBXLobeTraits all = RixBXLobeTraits(k_blinnLobe) |
+                          RixBXLobeTraits(k_mirrorLobe);
+    std::vector<RixBXLobeTraits> lobesWanted(numPts, all);
+    PluginLightOutputs cached(numPts, maxLights), uncached(numPts, maxLights);
+    std::vector<RtVector3> lights(numPts * maxLights);
+    PluginCounters counters;
+    PluginCounters::Totals scatter;
+    double differing = 0.;
+    unsigned int state = 5;
+
+    printf("  %d grids of %d points, width %g:%g, NdV %g:%g\n",
+           options.numGrids, numPts, options.width.lo, options.width.hi,
+           options.view.lo, options.view.hi);
+    printf("  %8s %14s %14s %10s\n", "lights", "cached ns", "uncached ns",
+           "speedup");
+    // row 0 only warms up the caches and the allocator
+    for (int row = 0; (1 << std::max(row - 1, 0)) <= maxLights; ++row)
+    {
+        int numLights = 1 << std::max(row - 1, 0);
+        PluginCounters::Totals once, every;
+        for (int g = 0; g < options.numGrids; ++g)
+        {
+            PluginGrid grid(instance, numPts, 41 + g);
+            RixRNG rng(numPts, g);
+            pluginRandomLights(lights, state);
+
+            // alternate which goes first, so neither gets the warmer cache
+            for (int run = 0; run < 2; ++run)
+            {
+                if ((run ^ g) & 1)
+                {
+                    counters.Start();
+                    RixBsdf *bsdf = factory->BeginScatter(&grid.sc, all,
+                        k_RixSCScatterQuery, instance.InstanceData());
+                    for (int l = 0; l < numLights; ++l)
+                        cached.Evaluate(bsdf, l, &lobesWanted[0], &rng,
+                                        &lights[0]);
+                    factory->EndScatter(bsdf);
+                    counters.Stop(once, (long long) numPts * numLights);
+                    grid.sc.Release();
+                    continue;
+                }
+                for (int l = 0; l < numLights; ++l)
+                {
+                    counters.Start();
+                    RixBsdf *bsdf = factory->BeginScatter(&grid.sc, all,
+                        k_RixSCScatterQuery, instance.InstanceData());
+                    uncached.Evaluate(bsdf, l, &lobesWanted[0], &rng,
+                                      &lights[0]);
+                    factory->EndScatter(bsdf);
+                    counters.Stop(every, numPts);
+                    grid.sc.Release();
+                }
+            }
+            for (int l = 0; l < numLights; ++l)
+                differing += cached.Differing(uncached, l);
+
+            if (row == 1)
+            {
+                counters.Start();
+                RixBsdf *bsdf = factory->BeginScatter(&grid.sc, all,
+                    k_RixSCScatterQuery, instance.InstanceData());
+                factory->EndScatter(bsdf);
+                counters.Stop(scatter, numPts);
+                grid.sc.Release();
+            }
+        }
+        if (!row)
+            continue;
+        double cachedNs = once.ns / (double) std::max(once.count, 1ll);
+        double uncachedNs = every.ns / (double) std::max(every.count, 1ll);
+        printf("  %8d %14.2f %14.2f %9.2fx\n", numLights, cachedNs,
+               uncachedNs, uncachedNs / std::max(cachedNs, 1e-9));
+    }
+    printf("  BeginScatter and EndScatter alone: %.2f ns per point\n",
+           scatter.ns / (double) std::max(scatter.count, 1ll));
+    return pluginReport("samples differing, cached or not", differing, 0.);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief GetConeAngle, reached through PxrBeckmannBsdf, gives every point
+/// beckmannConeAngle of its width and NdV, 0 for mirror points, and half
+/// of the directions GenerateSamples picks for a point fall inside its
+/// cone, at and off normal incidence (NdV .2 to 1, widths up to .4, see
+/// beckmannCheckConeAngle).
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkConeAngle(PluginOptions const &defaults)
+{
+    int numPts = 256, numSamples = 64;
+    double wrongAngle = 0., worstShare = 0.;
+    for (int k = 0; k < 2 * k_numDistributions; ++k)
+    {
+        PluginOptions options = defaults;
+        options.distribution = k % k_numDistributions;
+        options.samplingMode = (k / k_numDistributions) ? k_sampleVisible
+                                                        : k_sampleNdf;
+        options.width = PluginRange(.003f, .4f);
+        options.view = PluginRange(.2f, 1.f);
+        PluginInstance instance(options);
+        instance.CreateInstance();
+        RixBxdfFactory *factory = instance.Factory();
+        RixBXLobeTraits all = RixBXLobeTraits(k_blinnLobe) |
+                              RixBXLobeTraits(k_mirrorLobe);
+        std::vector<RixBXLobeTraits> lobesWanted(numPts, all);
+        PluginGrid grid(instance, numPts, 61 + k);
+        RixBsdf *bsdf = factory->BeginScatter(&grid.sc, all,
+                                              k_RixSCScatterQuery,
+                                              instance.InstanceData());
+        PxrBeckmannBsdf *beckmann = dynamic_cast<PxrBeckmannBsdf *>(bsdf);
+        if (!beckmann)
+        {
+            printf("  BeginScatter did not return a PxrBeckmannBsdf\n");
+            return false;
+        }
+
+        std::vector<RtFloat> cone(numPts);
+        beckmann->GetConeAngle(&cone[0]);
+        PluginSamples gen(numPts * numSamples);
+        RixRNG rng(numPts, k);
+        beckmann->GenerateSamples(numSamples, &lobesWanted[0], &rng,
+                                  &gen.lobeSampled[0], &gen.Ln[0], gen.W,
+                                  &gen.FPdf[0], &gen.RPdf[0]);
+
+        // Shares over the points of the microfacet lobe alone, where the
+        // mirror takes none of the samples.
+        long long inside = 0, total = 0;
+        for (int i = 0; i < numPts; ++i)
+        {
+            RtVector3 const &N = grid.Nn[i], &V = grid.Vn[i];
+            float NdV = N.Dot(V);
+            float width = grid.width[i];
+            // the default mirrorWidth and mirrorBand
+            float blend = beckmannMirrorBlend(width, .005f, .005f);
+            float expected = (blend > 0.f) ?
+                beckmannConeAngle(options.distribution, width, NdV) : 0.f;
+            wrongAngle += std::fabs(cone[i] - expected) >
+                          1e-5f * std::max(1.f, expected);
+            if (blend < 1.f)
+                continue;
+            RtVector3 R = 2.f * NdV * N - V;
+            float cosCone = std::cos(cone[i]);
+            for (int s = 0; s < numSamples; ++s)
+            {
+                int o = s * numPts + i;
+                inside += gen.lobeSampled[o].GetValid() &&
+                          gen.Ln[o].Dot(R) > cosCone;
+                ++total;
+            }
+        }
+        double share = (double) inside / (double) std::max(total, 1ll);
+        worstShare = std::max(worstShare, std::fabs(share - k_coneFraction));
+        factory->EndScatter(bsdf);
+        grid.sc.Release();
+    }
+    return pluginReport("cone angles differing from the kernels", wrongAngle,
+                        0.) &
+           pluginReport("share inside the cone error", worstShare, .05);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief GetAlbedo, reached through PxrBeckmannBsdf, agrees with the albedo
+/// GenerateSamples integrates for every point, from the mirror band into
+/// rough lobes and at grazing views: the mean difference, which the table
+/// would show as a bias, within 5e-3, and every point within .05, which
+/// leaves room for the noise of 256 samples.
+//----------------------------------------------------------------------------------------------------------------------
+bool
+checkAlbedo(PluginOptions const &defaults)
+{
+    int numPts = 256, numSamples = 256;
+    double worstBias = 0., worstPoint = 0.;
+    for (int k = 0; k < 2 * k_numDistributions; ++k)
+    {
+        PluginOptions options = defaults;
+        options.distribution = k % k_numDistributions;
+        options.samplingMode = (k / k_numDistributions) ? k_sampleVisible
+                                                        : k_sampleNdf;
+        options.width = PluginRange(.003f, .8f);
+        options.view = PluginRange(.05f, 1.f);
+        PluginInstance instance(options);
+        instance.CreateInstance();
+        RixBxdfFactory *factory = instance.Factory();
+        RixBXLobeTraits all = RixBXLobeTraits(k_blinnLobe) |
+                              RixBXLobeTraits(k_mirrorLobe);
+        std::vector<RixBXLobeTraits> lobesWanted(numPts, all);
+        PluginGrid grid(instance, numPts, 71 + k);
+        RixBsdf *bsdf = factory->BeginScatter(&grid.sc, all,
+                                              k_RixSCScatterQuery,
+                                              instance.InstanceData());
+        PxrBeckmannBsdf *beckmann = dynamic_cast<PxrBeckmannBsdf *>(bsdf);
+        if (!beckmann)
+        {
+            printf("  BeginScatter did not return a PxrBeckmannBsdf\n");
+            return false;
+        }
+
+        std::vector<RtColorRGB> albedo(numPts);
+        beckmann->GetAlbedo(&albedo[0]);
+        PluginSamples gen(numPts * numSamples);
+        RixRNG rng(numPts, 300 + k);
+        beckmann->GenerateSamples(numSamples, &lobesWanted[0], &rng,
+                                  &gen.lobeSampled[0], &gen.Ln[0], gen.W,
+                                  &gen.FPdf[0], &gen.RPdf[0]);
+        double bias = 0.;
+        for (int i = 0; i < numPts; ++i)
+        {
+            double integrated = 0.;
+            for (int s = 0; s < numSamples; ++s)
+                integrated += pluginAlbedoEstimate(gen, s * numPts + i);
+            double d = integrated / numSamples - albedo[i].r;
+            bias += d / numPts;
+            worstPoint = std::max(worstPoint, std::fabs(d));
+        }
+        worstBias = std::max(worstBias, std::fabs(bias));
+        factory->EndScatter(bsdf);
+        grid.sc.Release();
+    }
+    return pluginReport("mean albedo difference", worstBias, 5e-3) &
+           pluginReport("largest albedo difference", worstPoint, .05);
+}
+
+struct PluginCheck
+{
+    char const *name;
+    bool (*run)(PluginOptions const &);
+};
+
+const PluginCheck s_checks[] =
+{
+    { "entrypoints", checkEntryPoints },
+    { "lobes", checkLobes },
+    { "samples", checkSamples },
+    { "viewcache", checkViewCache },
+    { "coneangle", checkConeAngle },
+    { "albedo", checkAlbedo },
+    { "time", checkTime }
+};
+const int k_numChecks = sizeof(s_checks) / sizeof(s_checks[0]);
+
+int
+usage()
+{
+    fprintf(stderr,
+            "usage: PxrBeckmannPluginBench [--list] [check] [options]\n"
+            "  --points N        points per grid (256)\n"
+            "  --grids N         grids to shade (256)\n"
+            "  --lights N        samples per EvaluateSamplesAtIndex call (16)\n"
+            "  --samples K       samples per point of GenerateSamples (8)\n"
+            "  --width W|LO:HI   constant width, or uniform per point (.3)\n"
+            "  --view C|LO:HI    constant NdV, or uniform per point (.05:1)\n"
+            "  --distribution beckmann|blinnPhong|ggx\n"
+            "  --sampling ndf|visible\n");
+    return 2;
+}
+
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+    if (argc > 1 && !std::strcmp(argv[1], "--list"))
+    {
+        for (int c = 0; c < k_numChecks; ++c)
+            printf("%s\n", s_checks[c].name);
+        return 0;
+    }
+
+    char const *only = NULL;
+    PluginOptions options;
+    for (int a = 1; a < argc; ++a)
+    {
+        std::string arg = argv[a];
+        if (arg.compare(0, 2, "--"))
+        {
+            only = argv[a];
+            continue;
+        }
+        if (a + 1 >= argc)
+            return usage();
+        char const *value = argv[++a];
+        bool ok = true;
+        if (arg == "--points")
+            ok = (options.numPts = atoi(value)) > 0;
+        else if (arg == "--grids")
+            ok = (options.numGrids = atoi(value)) > 0;
+        else if (arg == "--lights")
+            ok = (options.numLights = atoi(value)) > 0;
+        else if (arg == "--samples")
+            ok = (options.numSamples = atoi(value)) > 0;
+        else if (arg == "--width")
+            ok = options.width.Parse(value) && options.width.lo > 0.f;
+        else if (arg == "--view")
+            ok = options.view.Parse(value) && options.view.lo >= 0.f &&
+                 options.view.hi <= 1.f;
+        else if (arg == "--distribution")
+        {
+            static char const *s_names[k_numDistributions] =
+            {
+                "beckmann", "blinnPhong", "ggx"
+            };
+            ok = false;
+            for (int d = 0; d < k_numDistributions; ++d)
+            {
+                if (!std::strcmp(value, s_names[d]))
+                {
+                    options.distribution = d;
+                    ok = true;
+                }
+            }
+        }
+        else if (arg == "--sampling")
+        {
+            ok = !std::strcmp(value, "ndf") || !std::strcmp(value, "visible");
+            options.samplingMode = std::strcmp(value, "visible") ?
+                                   k_sampleNdf : k_sampleVisible;
+        }
+        else
+            ok = false;
+        if (!ok)
+            return usage();
+    }
+
+    int failed = 0, run = 0;
+    for (int c = 0; c < k_numChecks; ++c)
+    {
+        if (only && std::strcmp(only, s_checks[c].name))
+            continue;
+        printf("%s\n", s_checks[c].name);
+        ++run;
+        if (!s_checks[c].run(options))
+            ++failed;
+    }
+    if (!run)
+    {
+        fprintf(stderr, "no check named %s, see --list\n", only);
+        return 2;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,172 @@
+//----------------------------------------------------------------------------------------------------------------------
+/// @file PxrBeckmannReplay.cpp
+/// @brief Replays a capture written by the plugin ($PXRBECKMANN_CAPTURE)
+/// through the block kernels and reports its records, the throughput of the
+/// kernels and a checksum of their outputs. With --compare it replays the
+/// capture through a second ISA variant as well and reports how far the two
+/// outputs are apart, and fails above --tolerance, so an optimisation can be
+/// checked against production grids rather than synthetic ones.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include "PxrBeckmannCapture.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+int
+usage()
+{
+    fprintf(stderr,
+            "usage: PxrBeckmannReplay capture [options]\n"
+            "  --isa NAME        kernels to replay with (the widest this cpu\n"
+            "                    runs, capped by $PXRBECKMANN_ISA)\n"
+            "  --compare NAME    also replay with these kernels and compare\n"
+            "  --tolerance T     largest difference --compare accepts,\n"
+            "                    relative to max(1, |value|) (1e-2)\n"
+            "  --repeat N        replays to time, the fastest is reported (1)\n"
+            "ISA names: baseline, sse4.2, avx2, avx512\n");
+    return 2;
+}
+
+// The PxrBeckmannIsa of name, or -1.
+int
+replayIsa(char const *name)
+{
+    for (int isa = 0; isa < k_numIsas; ++isa)
+    {
+        if (!std::strcmp(name, beckmannIsaName(isa)))
+            return isa;
+    }
+    return -1;
+}
+
+// Replays the capture repeat times with isa and prints the fastest. False
+// if the replays disagree with each other.
+bool
+replayTimed(PxrBeckmannCaptureReader &reader, int isa, int repeat,
+            std::vector<float> *outputs, PxrBeckmannReplayResult &best)
+{
+    bool stable = true;
+    for (int r = 0; r < repeat; ++r)
+    {
+        PxrBeckmannReplayResult result =
+            beckmannReplay(reader, r ? 0 : outputs, isa);
+        stable &= !r || result.checksum == best.checksum;
+        if (!r || result.seconds < best.seconds)
+            best = result;
+    }
+    printf("  %-10s %12lld lanes %10.4f s %10.2f Mlanes/s  checksum %016llx\n",
+           beckmannIsaName(isa), best.lanes, best.seconds,
+           best.lanes / std::max(best.seconds, 1e-12) * 1e-6,
+           (unsigned long long) best.checksum);
+    return stable;
+}
+
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+    if (argc < 2 || !std::strncmp(argv[1], "--", 2))
+        return usage();
+    char const *path = argv[1];
+    int isa = beckmannSelectIsa(getenv("PXRBECKMANN_ISA"));
+    int compare = -1;
+    int repeat = 1;
+    double tolerance = 1e-2;
+    for (int a = 2; a < argc; ++a)
+    {
+        std::string arg = argv[a];
+        if (a + 1 >= argc)
+            return usage();
+        char const *value = argv[++a];
+        bool ok = true;
+        if (arg == "--isa")
+            ok = (isa = replayIsa(value)) >= 0;
+        else if (arg == "--compare")
+            ok = (compare = replayIsa(value)) >= 0;
+        else if (arg == "--tolerance")
+            ok = (tolerance = atof(value)) >= 0.;
+        else if (arg == "--repeat")
+            ok = (repeat = atoi(value)) > 0;
+        else
+            ok = false;
+        if (!ok)
+            return usage();
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        int which = i ? compare : isa;
+        if (which >= 0 && !beckmannIsaSupported(which))
+        {
+            fprintf(stderr, "this cpu doesn't run the %s kernels\n",
+                    beckmannIsaName(which));
+            return 1;
+        }
+    }
+
+    PxrBeckmannCaptureReader reader;
+    if (!reader.Open(path))
+    {
+        fprintf(stderr, "%s is not a version %u capture\n", path,
+                k_captureVersion);
+        return 1;
+    }
+
+    long long records[4] = { 0, 0, 0, 0 };
+    long long points = 0;
+    PxrBeckmannCaptureView v;
+    while (reader.Next(v))
+    {
+        ++records[v.record->type & 3];
+        points += v.record->numPts;
+    }
+    printf("%s\n", path);
+    printf("  %lld GenerateSample, %lld EvaluateSample and %lld "
+           "EvaluateSamplesAtIndex records, %lld points\n",
+           records[k_captureGenerate], records[k_captureEvaluate],
+           records[k_captureEvaluateAtIndex], points);
+
+    std::vector<float> outputs[2];
+    PxrBeckmannReplayResult result[2];
+    bool ok = replayTimed(reader, isa, repeat, &outputs[0], result[0]);
+    if (!ok)
+        printf("  replays with the %s kernels disagree\n",
+               beckmannIsaName(isa));
+    if (compare < 0)
+        return ok ? 0 : 1;
+
+    ok &= replayTimed(reader, compare, repeat, &outputs[1], result[1]);
+    // Masked lanes are all zeros. Lanes one variant masks and the other
+    // doesn't, right at a threshold, are counted rather than compared, like
+    // beckmannCompareIsas does.
+    double worst = 0.;
+    long long masked = 0;
+    for (size_t l = 0; l + 6 <= outputs[0].size(); l += 6)
+    {
+        float const *x = &outputs[0][l], *y = &outputs[1][l];
+        bool xValid = x[4] != 0.f, yValid = y[4] != 0.f;
+        if (xValid != yValid)
+        {
+            ++masked;
+            continue;
+        }
+        for (int j = 0; j < 6; ++j)
+            worst = std::max(worst, (double) std::fabs(x[j] - y[j]) /
+                                    std::max(1., (double) std::fabs(x[j])));
+    }
+    bool within = worst <= tolerance;
+    printf("  %s against %s: largest difference %.4g (<= %g) %s, "
+           "%lld lanes masked differently, %s\n", beckmannIsaName(compare),
+           beckmannIsaName(isa), worst, tolerance, within ? "ok" : "FAILED",
+           masked, result[0].checksum == result[1].checksum ?
+           "bit identical" : "checksums differ");
+    return (ok && within) ? 0 : 1;
+}
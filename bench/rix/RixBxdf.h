@@ -0,0 +1,624 @@
+#ifndef RixBxdf_h
+#define RixBxdf_h
+//----------------------------------------------------------------------------------------------------------------------
+/// @file RixBxdf.h
+/// @brief A stand-in for the parts of the RenderMan 21 RixBxdf interface
+/// that PxrBeckmann uses, so bench/PxrBeckmannPluginBench can drive the
+/// plugin's entry points without RMANTREE. It is not Pixar's header. The
+/// signatures the plugin calls match RIS 21, and behind them the shading
+/// context, lobe traits, lobe weights, pool and parameter lists are small
+/// working versions that the harness fills in. Only what the plugin needs
+/// is here.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <alloca.h>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#define PRMAN_INLINE inline
+#define PRMANEXPORT
+#define RixAlloca alloca
+
+typedef float RtFloat;
+typedef int RtInt;
+typedef void *RtPointer;
+typedef void const *RtConstPointer;
+
+struct RtFloat2
+{
+    RtFloat x, y;
+};
+
+struct RtVector3
+{
+    RtFloat x, y, z;
+
+    RtVector3() {}
+    explicit RtVector3(RtFloat v) : x(v), y(v), z(v) {}
+    RtVector3(RtFloat x_, RtFloat y_, RtFloat z_) : x(x_), y(y_), z(z_) {}
+
+    RtFloat Dot(RtVector3 const &v) const { return x*v.x + y*v.y + z*v.z; }
+    RtVector3 Cross(RtVector3 const &v) const
+    {
+        return RtVector3(y*v.z - z*v.y, z*v.x - x*v.z, x*v.y - y*v.x);
+    }
+    RtFloat Length() const { return std::sqrt(Dot(*this)); }
+    void Normalize()
+    {
+        RtFloat l = Length();
+        if (l > 0.f)
+            *this = *this * (1.f / l);
+    }
+
+    RtVector3 operator-() const { return RtVector3(-x, -y, -z); }
+    RtVector3 operator+(RtVector3 const &v) const
+    {
+        return RtVector3(x + v.x, y + v.y, z + v.z);
+    }
+    RtVector3 operator-(RtVector3 const &v) const
+    {
+        return RtVector3(x - v.x, y - v.y, z - v.z);
+    }
+    RtVector3 operator*(RtFloat s) const { return RtVector3(x*s, y*s, z*s); }
+};
+
+inline RtVector3 operator*(RtFloat s, RtVector3 const &v) { return v * s; }
+
+typedef RtVector3 RtNormal3;
+typedef RtVector3 RtPoint3;
+
+struct RtColorRGB
+{
+    RtFloat r, g, b;
+
+    RtColorRGB() {}
+    explicit RtColorRGB(RtFloat v) : r(v), g(v), b(v) {}
+    RtColorRGB(RtFloat r_, RtFloat g_, RtFloat b_) : r(r_), g(g_), b(b_) {}
+
+    RtColorRGB operator+(RtColorRGB const &c) const
+    {
+        return RtColorRGB(r + c.r, g + c.g, b + c.b);
+    }
+    RtColorRGB operator-(RtColorRGB const &c) const
+    {
+        return RtColorRGB(r - c.r, g - c.g, b - c.b);
+    }
+    RtColorRGB operator*(RtColorRGB const &c) const
+    {
+        return RtColorRGB(r * c.r, g * c.g, b * c.b);
+    }
+    RtColorRGB operator*(RtFloat s) const { return RtColorRGB(r*s, g*s, b*s); }
+    bool operator==(RtColorRGB const &c) const
+    {
+        return r == c.r && g == c.g && b == c.b;
+    }
+    bool operator!=(RtColorRGB const &c) const { return !(*this == c); }
+
+    void ClampAlbedo()
+    {
+        r = std::min(std::max(r, 0.f), 1.f);
+        g = std::min(std::max(g, 0.f), 1.f);
+        b = std::min(std::max(b, 0.f), 1.f);
+    }
+};
+
+namespace RixConstants
+{
+    static const RtColorRGB k_ZeroRGB(0.f);
+    static const RtColorRGB k_OneRGB(1.f);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Interfaces handed out by the context
+//----------------------------------------------------------------------------------------------------------------------
+enum RixInterfaceId
+{
+    k_RixMessages
+};
+
+class RixInterface
+{
+public:
+    virtual ~RixInterface() {}
+};
+
+// Prints to stderr, or nothing once quiet is set.
+class RixMessages : public RixInterface
+{
+public:
+    RixMessages() : quiet(false) {}
+
+    void Info(char const *format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        print("I", format, args);
+        va_end(args);
+    }
+    void Warning(char const *format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        print("W", format, args);
+        va_end(args);
+    }
+    void Error(char const *format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        print("E", format, args);
+        va_end(args);
+    }
+
+    bool quiet;
+
+private:
+    void print(char const *level, char const *format, va_list args)
+    {
+        if (quiet)
+            return;
+        fprintf(stderr, "R0000%s ", level);
+        vfprintf(stderr, format, args);
+        fprintf(stderr, "\n");
+    }
+};
+
+class RixContext
+{
+public:
+    RixInterface *GetRixInterface(RixInterfaceId id)
+    {
+        return (id == k_RixMessages) ? &messages : NULL;
+    }
+
+    RixMessages messages;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+// Lobes. A sampled lobe is one lobe of the BxDF, traits are a set of them,
+// one bit per lobe id and kind (discrete or continuous).
+//----------------------------------------------------------------------------------------------------------------------
+class RixBXLobeSampled
+{
+public:
+    RixBXLobeSampled() : m_valid(false), m_discrete(false), m_id(0) {}
+    RixBXLobeSampled(bool discrete, unsigned char id) :
+        m_valid(true), m_discrete(discrete), m_id(id) {}
+
+    void SetValid(bool valid) { m_valid = valid; }
+    bool GetValid() const { return m_valid; }
+    bool GetDiscrete() const { return m_discrete; }
+    unsigned char GetLobeId() const { return m_id; }
+
+    // bit of the lobe in RixBXLobeTraits
+    uint32_t Bit() const { return 1u << (m_id + (m_discrete ? 16 : 0)); }
+
+private:
+    bool m_valid;
+    bool m_discrete;
+    unsigned char m_id;
+};
+
+class RixBXLobeTraits
+{
+public:
+    RixBXLobeTraits() : m_bits(0) {}
+    explicit RixBXLobeTraits(RixBXLobeSampled const &lobe) :
+        m_bits(lobe.GetValid() ? lobe.Bit() : 0) {}
+
+    static RixBXLobeTraits All()
+    {
+        RixBXLobeTraits t;
+        t.m_bits = ~0u;
+        return t;
+    }
+
+    bool HasAny() const { return m_bits != 0; }
+    void SetNone() { m_bits = 0; }
+
+    RixBXLobeTraits operator&(RixBXLobeTraits const &t) const
+    {
+        RixBXLobeTraits r;
+        r.m_bits = m_bits & t.m_bits;
+        return r;
+    }
+    RixBXLobeTraits operator|(RixBXLobeTraits const &t) const
+    {
+        RixBXLobeTraits r;
+        r.m_bits = m_bits | t.m_bits;
+        return r;
+    }
+    RixBXLobeTraits &operator&=(RixBXLobeTraits const &t)
+    {
+        m_bits &= t.m_bits;
+        return *this;
+    }
+    RixBXLobeTraits &operator|=(RixBXLobeTraits const &t)
+    {
+        m_bits |= t.m_bits;
+        return *this;
+    }
+    bool operator==(RixBXLobeTraits const &t) const { return m_bits == t.m_bits; }
+    bool operator!=(RixBXLobeTraits const &t) const { return m_bits != t.m_bits; }
+
+private:
+    uint32_t m_bits;
+};
+
+// The lobe with the given kind and id. The renderer looks lobes up by name,
+// here every name maps to its id.
+inline RixBXLobeSampled
+RixBXLookupLobeByName(RixContext &, bool discrete, bool /* specular */,
+                      bool /* reflect */, bool /* user */, unsigned char id,
+                      char const * /* name */)
+{
+    return RixBXLobeSampled(discrete, id);
+}
+
+// Per lobe weight arrays of numPts entries, owned by the caller. Adding a
+// lobe zeroes its array and returns it.
+class RixBXLobeWeights
+{
+public:
+    static const int k_maxLobes = 32;
+
+    RixBXLobeWeights(int numPts, RtColorRGB *storage) :
+        m_numPts(numPts),
+        m_storage(storage),
+        m_active(0)
+    {
+    }
+
+    RtColorRGB *AddActiveLobe(RixBXLobeSampled const &lobe)
+    {
+        int slot = slotOf(lobe);
+        RtColorRGB *w = m_storage + slot * m_numPts;
+        if (!(m_active & (1u << slot)))
+        {
+            std::fill_n(w, m_numPts, RixConstants::k_ZeroRGB);
+            m_active |= 1u << slot;
+        }
+        return w;
+    }
+
+    // NULL unless the lobe was added
+    RtColorRGB const *GetActiveLobe(RixBXLobeSampled const &lobe) const
+    {
+        int slot = slotOf(lobe);
+        return (m_active & (1u << slot)) ? m_storage + slot * m_numPts : NULL;
+    }
+
+    void ClearActiveLobes() { m_active = 0; }
+
+private:
+    static int slotOf(RixBXLobeSampled const &lobe)
+    {
+        return (lobe.GetLobeId() & 15) + (lobe.GetDiscrete() ? 16 : 0);
+    }
+
+    int m_numPts;
+    RtColorRGB *m_storage;  // k_maxLobes * numPts
+    uint32_t m_active;
+};
+
+enum RixBXTransportTrait
+{
+    k_RixBXDirectLighting = 1,
+    k_RixBXIndirectLighting = 2,
+    k_RixBXAllLighting = 3
+};
+
+enum RixBXEvaluateDomain
+{
+    k_RixBXEmptyDomain,
+    k_RixBXReflect,
+    k_RixBXTransmit,
+    k_RixBXBoth
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+// Shading context and parameters
+//----------------------------------------------------------------------------------------------------------------------
+enum RixSCType
+{
+    k_RixSCInvalidType,
+    k_RixSCInteger,
+    k_RixSCFloat,
+    k_RixSCColor
+};
+
+enum RixSCConnectionInfo
+{
+    k_RixSCDefaultValue,
+    k_RixSCParameter,
+    k_RixSCNetworkValue
+};
+
+enum RixSCDetail
+{
+    k_RixSCInvalidDetail,
+    k_RixSCUniform,
+    k_RixSCVarying
+};
+
+enum RixSCShadingMode
+{
+    k_RixSCScatterQuery,
+    k_RixSCOpacityQuery
+};
+
+enum RixSCSyncMsg
+{
+    k_RixSCRenderBegin,
+    k_RixSCRenderEnd,
+    k_RixSCInstanceEdit
+};
+
+struct RixSCParamInfo
+{
+    RixSCParamInfo() : name(NULL), type(k_RixSCInvalidType) {}
+    RixSCParamInfo(char const *n, RixSCType t) : name(n), type(t) {}
+
+    char const *name;  // NULL ends a table
+    RixSCType type;
+};
+
+// How one parameter is bound, shared by RixParameterList (the instance)
+// and RixShadingContext (a grid). A uniform value is read by both, a
+// network value is only known per grid, one value per point.
+struct RixParameterBinding
+{
+    RixParameterBinding() : info(k_RixSCDefaultValue), uniform(NULL),
+                            varying(NULL) {}
+
+    RixSCConnectionInfo info;
+    void const *uniform;  // k_RixSCParameter
+    void const *varying;  // k_RixSCNetworkValue, numPts values
+};
+
+class RixParameterList
+{
+public:
+    RixParameterList(RixParameterBinding const *params, int numParams) :
+        m_params(params), m_numParams(numParams) {}
+
+    int GetParamInfo(int id, RixSCType *type, RixSCConnectionInfo *cinfo,
+                     int *isArray = NULL) const
+    {
+        *type = k_RixSCInvalidType;
+        *cinfo = (id < m_numParams) ? m_params[id].info : k_RixSCDefaultValue;
+        if (isArray)
+            *isArray = 0;
+        return 0;
+    }
+
+    template <typename T>
+    int EvalParam(int id, int /* arrayIndex */, T *result) const
+    {
+        if (id >= m_numParams || m_params[id].info != k_RixSCParameter)
+            return 1;
+        *result = *(T const *) m_params[id].uniform;
+        return 0;
+    }
+
+private:
+    RixParameterBinding const *m_params;
+    int m_numParams;
+};
+
+class RixShadingContext
+{
+public:
+    enum BuiltinVar
+    {
+        k_P,
+        k_Nn,
+        k_Ngn,
+        k_Tn,
+        k_Vn,
+        k_incidentRaySpread,
+        k_numBuiltinVars
+    };
+
+    struct Traits
+    {
+        bool primaryHit;
+        bool eyePath;
+    };
+
+    RixShadingContext() :
+        numPts(0),
+        params(NULL),
+        numParams(0),
+        evalParamCalls(0)
+    {
+        scTraits.primaryHit = true;
+        scTraits.eyePath = true;
+        std::memset(builtins, 0, sizeof(builtins));
+    }
+    ~RixShadingContext() { Release(); }
+
+    template <typename T>
+    void GetBuiltinVar(BuiltinVar var, T const **result) const
+    {
+        *result = (T const *) builtins[var];
+    }
+
+    // Uniform and default values are one value, network values numPts of
+    // them unless promoted (isVarying) from a uniform one.
+    template <typename T>
+    RixSCDetail EvalParam(int id, int /* arrayIndex */, T const **result,
+                          T const *dflt, bool isVarying) const
+    {
+        ++evalParamCalls;
+        RixParameterBinding const *p = (id < numParams) ? &params[id] : NULL;
+        T const *value = dflt;
+        RixSCDetail detail = k_RixSCUniform;
+        if (p && p->info == k_RixSCNetworkValue)
+        {
+            *result = (T const *) p->varying;
+            return k_RixSCVarying;
+        }
+        if (p && p->info == k_RixSCParameter)
+            value = (T const *) p->uniform;
+        if (isVarying)
+        {
+            T *promoted = (T *) Alloc(sizeof(T) * numPts);
+            std::fill_n(promoted, numPts, *value);
+            value = promoted;
+            detail = k_RixSCVarying;
+        }
+        *result = value;
+        return detail;
+    }
+
+    // Pool memory, freed by Release once the grid is done.
+    void *Alloc(size_t size) const
+    {
+        void *mem = NULL;
+        if (posix_memalign(&mem, 64, std::max<size_t>(size, 1)))
+            throw std::bad_alloc();
+        pool.push_back(mem);
+        return mem;
+    }
+    void Release() const
+    {
+        for (size_t i = 0; i < pool.size(); ++i)
+            free(pool[i]);
+        pool.clear();
+    }
+
+    class Allocator
+    {
+    public:
+        Allocator(RixShadingContext const *sc) : m_sc(sc) {}
+        template <typename T>
+        T *AllocForBxdf(int n) { return (T *) m_sc->Alloc(sizeof(T) * n); }
+    private:
+        RixShadingContext const *m_sc;
+    };
+
+    RtInt numPts;
+    Traits scTraits;
+    void const *builtins[k_numBuiltinVars];
+    RixParameterBinding const *params;
+    int numParams;
+    mutable long long evalParamCalls;
+
+private:
+    mutable std::vector<void *> pool;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+// BxDF interfaces, with the RENDERMAN21 signatures
+//----------------------------------------------------------------------------------------------------------------------
+class RixRNG;
+class RixBxdfFactory;
+
+class RixBsdf
+{
+public:
+    RixBsdf(RixShadingContext const *sc, RixBxdfFactory *factory) :
+        shadingCtx(sc), bxdfFactory(factory) {}
+    virtual ~RixBsdf() {}
+
+    virtual RixBXEvaluateDomain GetEvaluateDomain() = 0;
+    virtual void GetAggregateLobeTraits(RixBXLobeTraits *t) = 0;
+
+    virtual void GenerateSample(RixBXTransportTrait transportTrait,
+                                RixBXLobeTraits const *lobesWanted,
+                                RixRNG *rng,
+                                RixBXLobeSampled *lobeSampled,
+                                RtVector3 *Ln,
+                                RixBXLobeWeights &W,
+                                RtFloat *FPdf, RtFloat *RPdf,
+                                RtColorRGB *compTrans) = 0;
+
+    virtual void EvaluateSample(RixBXTransportTrait transportTrait,
+                                RixBXLobeTraits const *lobesWanted,
+                                RixRNG *rng,
+                                RixBXLobeTraits *lobesEvaluated,
+                                RtVector3 const *Ln, RixBXLobeWeights &W,
+                                RtFloat *FPdf, RtFloat *RPdf) = 0;
+
+    virtual void EvaluateSamplesAtIndex(RixBXTransportTrait transportTrait,
+                                        RixBXLobeTraits const &lobesWanted,
+                                        RixRNG *rng,
+                                        RtInt index, RtInt nsamps,
+                                        RixBXLobeTraits *lobesEvaluated,
+                                        RtVector3 const *Ln,
+                                        RixBXLobeWeights &W,
+                                        RtFloat *FPdf, RtFloat *RPdf) = 0;
+
+    RixBXLobeTraits GetAllLobeTraits() { return RixBXLobeTraits::All(); }
+
+    RixShadingContext const *shadingCtx;
+    RixBxdfFactory *bxdfFactory;
+};
+
+class RixOpacity
+{
+public:
+    RixOpacity(RixShadingContext const *sc, RixBxdfFactory *factory) :
+        shadingCtx(sc), bxdfFactory(factory) {}
+    virtual ~RixOpacity() {}
+
+    virtual bool GetPresence(RtFloat *result) = 0;
+    virtual bool GetOpacity(RtColorRGB *result) = 0;
+
+    RixShadingContext const *shadingCtx;
+    RixBxdfFactory *bxdfFactory;
+};
+
+class RixBxdfFactory
+{
+public:
+    enum InstanceHints
+    {
+        k_TriviallyOpaque = 0,
+        k_OpacityCanBeCached = 1,
+        k_ComputesOpacity = 2,
+        k_ComputesPresence = 4,
+        k_PresenceCanBeCached = 8
+    };
+
+    struct InstanceData
+    {
+        InstanceData() : data(NULL), freefunc(NULL) {}
+        RtPointer data;
+        void (*freefunc)(RtPointer);
+    };
+
+    virtual ~RixBxdfFactory() {}
+
+    virtual int Init(RixContext &, char const *pluginpath) = 0;
+    virtual RixSCParamInfo const *GetParamTable() = 0;
+    virtual void Finalize(RixContext &) = 0;
+    virtual void Synchronize(RixContext &, RixSCSyncMsg,
+                             RixParameterList const *) {}
+    virtual int CreateInstanceData(RixContext &, char const * /* handle */,
+                                   RixParameterList const *,
+                                   InstanceData *) { return -1; }
+    virtual int GetInstanceHints(RtConstPointer) const
+    {
+        return k_TriviallyOpaque;
+    }
+    virtual RixBsdf *BeginScatter(RixShadingContext const *,
+                                  RixBXLobeTraits const &lobesWanted,
+                                  RixSCShadingMode,
+                                  RtConstPointer instanceData) = 0;
+    virtual void EndScatter(RixBsdf *) = 0;
+    virtual RixOpacity *BeginOpacity(RixShadingContext const *,
+                                     RixSCShadingMode,
+                                     RtConstPointer) { return NULL; }
+    virtual void EndOpacity(RixOpacity *) {}
+};
+
+#endif
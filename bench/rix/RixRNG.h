@@ -0,0 +1,67 @@
+#ifndef RixRNG_h
+#define RixRNG_h
+//----------------------------------------------------------------------------------------------------------------------
+/// @file RixRNG.h
+/// @brief Stand-in for RenderMan 21's RixRNG, see RixBxdf.h. Every point has
+/// its own stream, a hash of the seed, the point and how many samples it
+/// has drawn, so runs repeat and draws don't depend on the grid size.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include "RixBxdf.h"
+
+class RixRNG
+{
+public:
+    RixRNG(int numPts, uint32_t seed) :
+        m_seed(seed), m_draws(numPts, 0), m_next2D(NULL) {}
+
+    // Not in RIS: the next DrawSamples2D returns xi rather than drawing, so
+    // checks can hand GenerateSample the samples they want.
+    void SetNext2D(RtFloat2 const *xi) { m_next2D = xi; }
+
+    void DrawSamples1D(int n, RtFloat *xi)
+    {
+        for (int i = 0; i < n; ++i)
+            xi[i] = next(i);
+    }
+
+    void DrawSamples2D(int n, RtFloat2 *xi)
+    {
+        if (m_next2D)
+        {
+            std::copy(m_next2D, m_next2D + n, xi);
+            m_next2D = NULL;
+            return;
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            xi[i].x = next(i);
+            xi[i].y = next(i);
+        }
+    }
+
+private:
+    // [0, 1) with 24 bits, hashing the seed, the point and the draw in turn
+    RtFloat next(int i)
+    {
+        uint32_t h = mix(mix(mix(m_seed) + (uint32_t) i) + m_draws[i]++);
+        return (RtFloat) (h >> 8) * (1.f / 16777216.f);
+    }
+
+    // murmur3 style finalizer
+    static uint32_t mix(uint32_t h)
+    {
+        h ^= h >> 16;
+        h *= 0x7feb352du;
+        h ^= h >> 15;
+        h *= 0x846ca68bu;
+        h ^= h >> 16;
+        return h;
+    }
+
+    uint32_t m_seed;
+    std::vector<uint32_t> m_draws;
+    RtFloat2 const *m_next2D;
+};
+
+#endif
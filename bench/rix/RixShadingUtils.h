@@ -0,0 +1,27 @@
+#ifndef RixShadingUtils_h
+#define RixShadingUtils_h
+//----------------------------------------------------------------------------------------------------------------------
+/// @file RixShadingUtils.h
+/// @brief Stand-in for RenderMan's RixShadingUtils.h, see RixBxdf.h.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include "RixBxdf.h"
+
+// Orthonormal TX, TY around N, with TX following the tangent T.
+inline void
+RixComputeShadingBasis(RtNormal3 const &N, RtVector3 const &T,
+                       RtVector3 &TX, RtVector3 &TY)
+{
+    TY = N.Cross(T);
+    if (TY.Dot(TY) < 1e-12f)
+    {
+        // T along N, any perpendicular will do
+        RtVector3 A = std::fabs(N.x) < .9f ? RtVector3(1.f, 0.f, 0.f) :
+                                             RtVector3(0.f, 1.f, 0.f);
+        TY = N.Cross(A);
+    }
+    TY.Normalize();
+    TX = TY.Cross(N);
+}
+
+#endif
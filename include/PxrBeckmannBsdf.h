@@ -0,0 +1,61 @@
+#ifndef PxrBeckmannBsdf_h
+#define PxrBeckmannBsdf_h
+//----------------------------------------------------------------------------------------------------------------------
+/// @file PxrBeckmannBsdf.h
+/// @brief What the PxrBeckmann BxDF offers beyond RixBsdf. RIS only calls the
+/// RixBsdf entry points, so integrators that know about PxrBeckmann reach
+/// the rest by casting the RixBsdf that BeginScatter returned:
+///
+///     PxrBeckmannBsdf *b = dynamic_cast<PxrBeckmannBsdf *>(bsdf);
+///     if (b)
+///         b->GetConeAngle(coneAngle);
+///
+/// Unlike the other headers in include/ this one needs the RIS headers.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include "RixBxdf.h"
+#ifdef RENDERMAN21
+    #include "RixRNG.h"
+#endif
+
+class PxrBeckmannBsdf : public RixBsdf
+{
+public:
+    PxrBeckmannBsdf(RixShadingContext const *sc, RixBxdfFactory *bx) :
+        RixBsdf(sc, bx)
+    {
+    }
+
+    // Generates numSamples directions for every point of the grid in one
+    // pass, for splitting integrators and progressive lookdev passes. The
+    // outputs are sample major, sample k of point i at k * numPts + i, so
+    // every array and W must have room for numSamples * numPts points. A
+    // single rng->DrawSamples2D(numPts) gives each point numSamples
+    // stratified samples, and the view terms, shading basis, lobe tests and
+    // roulette are worked out once per point for all of them. Sample k is
+    // what GenerateSample returns for xi = beckmannLatticeSample(k,
+    // numSamples, shift) of the point's draw.
+    virtual void GenerateSamples(int numSamples,
+                                 RixBXLobeTraits const *lobesWanted,
+                                 RixRNG *rng,
+                                 RixBXLobeSampled *lobeSampled,
+                                 RtVector3 *Ln,
+                                 RixBXLobeWeights &W,
+                                 RtFloat *FPdf, RtFloat *RPdf) = 0;
+
+    // Spread of the rays this lobe scatters, as the half angle in radians
+    // of the cone around the mirror direction holding half of them (see
+    // beckmannConeAngle), 0 for points shaded as a mirror. The RixBsdf
+    // interface has no way to hand a spread back with generated samples,
+    // so integrators that want to widen the ray differentials of secondary
+    // rays, and with them texture filter widths and geometric LOD, ask for
+    // it here. coneAngle has numPts entries.
+    virtual void GetConeAngle(RtFloat *coneAngle) = 0;
+
+    // Directional albedo estimate of every shading point, the color times
+    // the tabulated albedo of its lobe, cheap enough to drive russian
+    // roulette and lobe selection. albedo has numPts entries.
+    virtual void GetAlbedo(RtColorRGB *albedo) = 0;
+};
+
+#endif
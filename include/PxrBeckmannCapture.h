@@ -0,0 +1,430 @@
+#ifndef PxrBeckmannCapture_h
+#define PxrBeckmannCapture_h
+//----------------------------------------------------------------------------------------------------------------------
+/// @file PxrBeckmannCapture.h
+/// @brief Capture of real shading grids and their replay through the kernels.
+/// With $PXRBECKMANN_CAPTURE set the plugin appends the inputs of every
+/// GenerateSample, EvaluateSample and EvaluateSamplesAtIndex call to that
+/// file. The file is a header followed by self sized records of plain
+/// float arrays, so a reader can mmap it and point straight into it.
+/// beckmannReplay streams a capture through the block kernels and reports
+/// the throughput and a checksum of every output, to tune against
+/// production distributions and to check that an optimisation keeps the
+/// outputs identical (or, through the outputs array, within a tolerance).
+/// Renderer free like PxrBeckmannKernels.h.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include "PxrBeckmannDispatch.h"
+#include "PxrBeckmannKernels.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+    #include <fstream>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Bump on any change to the layout below.
+static const uint32_t k_captureVersion = 2;
+static const char k_captureMagic[8] = { 'P', 'X', 'R', 'B', 'K', 'C', 'A', 'P' };
+
+enum PxrBeckmannCaptureType
+{
+    k_captureGenerate = 1,         // followed by xi
+    k_captureEvaluate = 2,         // followed by one Ln per point
+    k_captureEvaluateAtIndex = 3   // one point, followed by numSamples Ln
+};
+
+struct PxrBeckmannCaptureHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;  // sizeof(PxrBeckmannCaptureHeader)
+};
+
+// Every record is this header followed by, as packed float arrays,
+//   Nn[3 n], Ngn[3 n], Tn[3 n], Vn[3 n], color[3 n], width[n],
+//   xi[2 n] for k_captureGenerate, Ln[3 numSamples] otherwise
+// with n = numPts. Everything is 4 byte sized so the arrays stay aligned.
+struct PxrBeckmannCaptureRecord
+{
+    uint32_t type;         // PxrBeckmannCaptureType
+    uint32_t size;         // bytes, including this header
+    uint32_t numPts;
+    uint32_t numSamples;   // Ln count
+    uint32_t index;        // grid index of an EvaluateSamplesAtIndex point
+    int32_t samplingMode;  // PxrBeckmannSamplingMode
+    int32_t distribution;  // PxrBeckmannDistribution
+    float mirrorWidth;
+    float mirrorBand;
+};
+
+inline uint32_t
+beckmannCaptureSize(uint32_t type, uint32_t numPts, uint32_t numSamples)
+{
+    uint32_t floats = 16 * numPts +
+                      ((type == k_captureGenerate) ? 2 * numPts : 3 * numSamples);
+    return (uint32_t) sizeof(PxrBeckmannCaptureRecord) + 4 * floats;
+}
+
+// Appends records to a capture file. Safe to call from every shading
+// thread: each record is built on the caller's stack and written under a
+// lock in one go. Stops quietly once maxBytes have been written.
+class PxrBeckmannCaptureWriter
+{
+public:
+    PxrBeckmannCaptureWriter(char const *path, uint64_t maxBytes) :
+        m_maxBytes(maxBytes),
+        m_bytes(0)
+    {
+        m_file = fopen(path, "wb");
+        if (!m_file)
+            return;
+        PxrBeckmannCaptureHeader header;
+        std::memcpy(header.magic, k_captureMagic, sizeof(header.magic));
+        header.version = k_captureVersion;
+        header.headerSize = sizeof(header);
+        fwrite(&header, sizeof(header), 1, m_file);
+        m_bytes = sizeof(header);
+    }
+
+    ~PxrBeckmannCaptureWriter()
+    {
+        if (m_file)
+            fclose(m_file);
+    }
+
+    bool IsOpen() const { return m_file != 0; }
+
+    // A record under construction. Arrays are appended in the order listed
+    // at PxrBeckmannCaptureRecord; a uniform array (stride 0) is repeated
+    // for every point.
+    class Record
+    {
+    public:
+        Record(uint32_t type, uint32_t numPts, uint32_t numSamples,
+               uint32_t index, int samplingMode, int distribution,
+               float mirrorWidth, float mirrorBand)
+        {
+            m_data.reserve(beckmannCaptureSize(type, numPts, numSamples));
+            PxrBeckmannCaptureRecord r;
+            r.type = type;
+            r.size = beckmannCaptureSize(type, numPts, numSamples);
+            r.numPts = numPts;
+            r.numSamples = numSamples;
+            r.index = index;
+            r.samplingMode = samplingMode;
+            r.distribution = distribution;
+            r.mirrorWidth = mirrorWidth;
+            r.mirrorBand = mirrorBand;
+            append(&r, sizeof(r));
+        }
+
+        void Add(float const *values, int count, int components, int stride = 1)
+        {
+            if (stride)
+                append(values, sizeof(float) * count * components);
+            else
+                for (int i = 0; i < count; ++i)
+                    append(values, sizeof(float) * components);
+        }
+
+        std::vector<char> const &Data() const { return m_data; }
+
+    private:
+        void append(void const *p, size_t bytes)
+        {
+            char const *c = (char const *) p;
+            m_data.insert(m_data.end(), c, c + bytes);
+        }
+        std::vector<char> m_data;
+    };
+
+    void Write(Record const &record)
+    {
+        std::vector<char> const &data = record.Data();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_file || m_bytes + data.size() > m_maxBytes)
+            return;
+        fwrite(&data[0], 1, data.size(), m_file);
+        m_bytes += data.size();
+    }
+
+private:
+    FILE *m_file;
+    uint64_t m_maxBytes;
+    uint64_t m_bytes;
+    std::mutex m_mutex;
+};
+
+// One record of a mapped capture, pointing into the mapping.
+struct PxrBeckmannCaptureView
+{
+    PxrBeckmannCaptureRecord const *record;
+    float const *Nn, *Ngn, *Tn, *Vn;
+    float const *color, *width;
+    float const *xi;   // k_captureGenerate only
+    float const *Ln;   // otherwise
+};
+
+// Maps a capture file read only and walks its records without copying.
+// Windows reads the file into memory instead.
+class PxrBeckmannCaptureReader
+{
+public:
+    PxrBeckmannCaptureReader() : m_data(0), m_size(0), m_offset(0) {}
+    ~PxrBeckmannCaptureReader() { Close(); }
+
+    bool Open(char const *path)
+    {
+        Close();
+#ifdef _WIN32
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return false;
+        m_buffer.assign(std::istreambuf_iterator<char>(in),
+                        std::istreambuf_iterator<char>());
+        m_data = m_buffer.empty() ? 0 : &m_buffer[0];
+        m_size = m_buffer.size();
+#else
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+        void *p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            return false;
+        m_data = (char const *) p;
+        m_size = st.st_size;
+#endif
+        PxrBeckmannCaptureHeader const *header =
+            (PxrBeckmannCaptureHeader const *) m_data;
+        if (m_size < sizeof(*header) ||
+            std::memcmp(header->magic, k_captureMagic, sizeof(header->magic)) ||
+            header->version != k_captureVersion ||
+            header->headerSize != sizeof(*header))
+        {
+            Close();
+            return false;
+        }
+        Rewind();
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        m_buffer.clear();
+#else
+        if (m_data)
+            munmap((void *) m_data, m_size);
+#endif
+        m_data = 0;
+        m_size = 0;
+    }
+
+    void Rewind() { m_offset = sizeof(PxrBeckmannCaptureHeader); }
+
+    // Fills v with the next record, false at the end of the file or at a
+    // truncated or corrupt record.
+    bool Next(PxrBeckmannCaptureView &v)
+    {
+        if (!m_data || m_offset + sizeof(PxrBeckmannCaptureRecord) > m_size)
+            return false;
+        PxrBeckmannCaptureRecord const *r =
+            (PxrBeckmannCaptureRecord const *) (m_data + m_offset);
+        if (r->size != beckmannCaptureSize(r->type, r->numPts, r->numSamples) ||
+            m_offset + r->size > m_size)
+            return false;
+
+        float const *f = (float const *) (r + 1);
+        uint32_t n = r->numPts;
+        v.record = r;
+        v.Nn = f;        f += 3 * n;
+        v.Ngn = f;       f += 3 * n;
+        v.Tn = f;        f += 3 * n;
+        v.Vn = f;        f += 3 * n;
+        v.color = f;     f += 3 * n;
+        v.width = f;     f += n;
+        v.xi = (r->type == k_captureGenerate) ? f : 0;
+        v.Ln = (r->type == k_captureGenerate) ? 0 : f;
+        m_offset += r->size;
+        return true;
+    }
+
+private:
+    char const *m_data;
+    size_t m_size;
+    size_t m_offset;
+#ifdef _WIN32
+    std::vector<char> m_buffer;
+#endif
+};
+
+struct PxrBeckmannReplayResult
+{
+    long long records;
+    long long lanes;        // kernel lanes run
+    double seconds;         // time in the gathers and kernels, not the
+                            // checksum or the outputs copy
+    uint64_t checksum;      // FNV-1a of every lane's outputs
+};
+
+// Tangent frame around N from the captured Tn, Gram-Schmidt like
+// RixComputeShadingBasis. The plugin's frame may differ in the last bits,
+// so compare replays with replays rather than with the renderer.
+inline void
+beckmannCaptureBasis(float const *N, float const *T, float *TX, float *TY)
+{
+    float d = N[0]*T[0] + N[1]*T[1] + N[2]*T[2];
+    float x = T[0] - d * N[0], y = T[1] - d * N[1], z = T[2] - d * N[2];
+    float len = sqrtf(x*x + y*y + z*z);
+    if (len < 1e-6f)
+    {
+        // Tn parallel to N, any perpendicular will do
+        x = (fabsf(N[0]) < .9f) ? 0.f : -N[1];
+        y = (fabsf(N[0]) < .9f) ? -N[2] : N[0];
+        z = (fabsf(N[0]) < .9f) ? N[1] : 0.f;
+        len = sqrtf(x*x + y*y + z*z);
+    }
+    TX[0] = x / len; TX[1] = y / len; TX[2] = z / len;
+    TY[0] = N[1]*TX[2] - N[2]*TX[1];
+    TY[1] = N[2]*TX[0] - N[0]*TX[2];
+    TY[2] = N[0]*TX[1] - N[1]*TX[0];
+}
+
+inline void
+beckmannChecksum(uint64_t &hash, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 4; ++i)
+    {
+        hash ^= (bits >> (8 * i)) & 0xffu;
+        hash *= 1099511628211ull;
+    }
+}
+
+// Runs the block kernels over every record of a capture, like the plugin
+// does after its roulette and mirror pre-pass (which are not replayed).
+// If outputs is given, L, radiance, FPdf and RPdf of every lane are
+// appended to it (zeros for masked lanes) for tolerance checks. isa picks
+// the kernel variant, see PxrBeckmannDispatch.h.
+inline PxrBeckmannReplayResult
+beckmannReplay(PxrBeckmannCaptureReader &reader,
+               std::vector<float> *outputs = 0, int isa = k_isaBaseline)
+{
+    PxrBeckmannKernelTable const &kernels = beckmannKernelTable(isa);
+    PxrBeckmannReplayResult result;
+    result.records = 0;
+    result.lanes = 0;
+    result.seconds = 0.;
+    result.checksum = 14695981039346656037ull;
+
+    PxrBeckmannSoABlock b;
+    PxrBeckmannCaptureView v;
+    reader.Rewind();
+    std::chrono::steady_clock::time_point start;
+
+    while (reader.Next(v))
+    {
+        PxrBeckmannCaptureRecord const &r = *v.record;
+        bool generate = (r.type == k_captureGenerate);
+        uint32_t numLanes = (r.type == k_captureEvaluateAtIndex) ?
+                            r.numSamples : r.numPts;
+        ++result.records;
+
+        int n = 0;
+        for (uint32_t k = 0; k <= numLanes; ++k)
+        {
+            // Each block is timed from its first gathered lane to the end
+            // of its kernel call
+            if (!n)
+                start = std::chrono::steady_clock::now();
+            if (k < numLanes)
+            {
+                uint32_t i = (r.type == k_captureEvaluateAtIndex) ? 0 : k;
+                float const *N = v.Nn + 3 * i;
+                float const *V = v.Vn + 3 * i;
+                float NdV = N[0]*V[0] + N[1]*V[1] + N[2]*V[2];
+                float flip = (NdV >= 0.f) ? 1.f : -1.f;
+                float Nf[3] = { flip * N[0], flip * N[1], flip * N[2] };
+                float width = v.width[i];
+
+                b.index[n] = k;
+                b.Nx[n] = Nf[0]; b.Ny[n] = Nf[1]; b.Nz[n] = Nf[2];
+                b.Vx[n] = V[0];  b.Vy[n] = V[1];  b.Vz[n] = V[2];
+                b.NdV[n] = flip * NdV;
+                b.width[n] = width;
+                b.blend[n] = beckmannMirrorBlend(width, r.mirrorWidth,
+                                                 r.mirrorBand);
+                beckmannViewTerms(r.samplingMode, b.NdV[n], width, b.G1V[n],
+                                  b.G1ExactV[n], b.invWidthSqrd[n], b.normD[n],
+                                  r.distribution);
+                if (generate)
+                {
+                    float TX[3], TY[3];
+                    beckmannCaptureBasis(Nf, v.Tn + 3 * i, TX, TY);
+                    b.TXx[n] = TX[0]; b.TXy[n] = TX[1]; b.TXz[n] = TX[2];
+                    b.TYx[n] = TY[0]; b.TYy[n] = TY[1]; b.TYz[n] = TY[2];
+                    b.xi0[n] = v.xi[2 * k];
+                    b.xi1[n] = v.xi[2 * k + 1];
+                }
+                else
+                {
+                    b.Lx[n] = v.Ln[3 * k];
+                    b.Ly[n] = v.Ln[3 * k + 1];
+                    b.Lz[n] = v.Ln[3 * k + 2];
+                }
+                if (++n < k_soaBlockSize)
+                    continue;
+            }
+            if (!n)
+                break;
+
+            if (generate)
+                kernels.generate(b, n, r.samplingMode, r.distribution, true);
+            else
+                kernels.evaluate(b, n, r.samplingMode, r.distribution, true);
+            result.seconds += std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() - start).count();
+            result.lanes += n;
+
+            for (int l = 0; l < n; ++l)
+            {
+                float out[6] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+                if (b.valid[l])
+                {
+                    out[0] = generate ? b.Lx[l] : 0.f;
+                    out[1] = generate ? b.Ly[l] : 0.f;
+                    out[2] = generate ? b.Lz[l] : 0.f;
+                    out[3] = b.radiance[l];
+                    out[4] = b.FPdf[l];
+                    out[5] = b.RPdf[l];
+                }
+                for (int c = 0; c < 6; ++c)
+                    beckmannChecksum(result.checksum, out[c]);
+                if (outputs)
+                    outputs->insert(outputs->end(), out, out + 6);
+            }
+            n = 0;
+        }
+    }
+    return result;
+}
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef PxrBeckmannDispatch_h
+#define PxrBeckmannDispatch_h
+//----------------------------------------------------------------------------------------------------------------------
+/// @file PxrBeckmannDispatch.h
+/// @brief Copies of the block kernels compiled for several x86 ISA levels,
+/// picked at runtime from cpuid, so one plugin binary uses wide vectors on
+/// new nodes and still loads on old ones. Each copy is a thin wrapper with
+/// a target attribute that flattens the shared kernel code into itself, so
+/// there is only one source for the math. Other compilers and architectures
+/// get the baseline kernels only.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include "PxrBeckmannKernels.h"
+#include <cstring>
+
+enum PxrBeckmannIsa
+{
+    k_isaBaseline,   // whatever the plugin was compiled for
+    k_isaSse42,
+    k_isaAvx2,       // with FMA
+    k_isaAvx512,     // F, VL and DQ
+    k_numIsas
+};
+
+typedef void (*PxrBeckmannBlockKernel)(PxrBeckmannSoABlock &b, int n,
+                                       int samplingMode, int distribution,
+                                       bool reverse);
+
+struct PxrBeckmannKernelTable
+{
+    int isa;  // PxrBeckmannIsa
+    PxrBeckmannBlockKernel generate;
+    PxrBeckmannBlockKernel evaluate;
+};
+
+inline char const *
+beckmannIsaName(int isa)
+{
+    static char const *s_names[k_numIsas] =
+    {
+        "baseline",
+        "sse4.2",
+        "avx2",
+        "avx512"
+    };
+    return s_names[isa];
+}
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define PXRBECKMANN_MULTI_ISA
+#endif
+
+#ifdef PXRBECKMANN_MULTI_ISA
+
+// The sse4.2 kernels match the baseline bit for bit. The FMA ones round
+// a*b+c once instead of twice, see beckmannCompareIsas.
+#define PXRBECKMANN_ISA_KERNELS(suffix, isaTarget)                               \
+    __attribute__((target(isaTarget), flatten)) inline void                      \
+    beckmannGenerateBlock_##suffix(PxrBeckmannSoABlock &b, int n,                \
+                                   int samplingMode, int distribution,           \
+                                   bool reverse)                                 \
+    {                                                                            \
+        beckmannGenerateBlock(b, n, samplingMode, distribution, reverse);        \
+    }                                                                            \
+    __attribute__((target(isaTarget), flatten)) inline void                      \
+    beckmannEvaluateBlock_##suffix(PxrBeckmannSoABlock &b, int n,                \
+                                   int samplingMode, int distribution,           \
+                                   bool reverse)                                 \
+    {                                                                            \
+        beckmannEvaluateBlock(b, n, samplingMode, distribution, reverse);        \
+    }
+
+PXRBECKMANN_ISA_KERNELS(sse42, "sse4.2")
+PXRBECKMANN_ISA_KERNELS(avx2, "avx2,fma")
+PXRBECKMANN_ISA_KERNELS(avx512, "avx512f,avx512vl,avx512dq,avx2,fma")
+
+#undef PXRBECKMANN_ISA_KERNELS
+
+#endif
+
+// True if this build has kernels for isa and the cpu (and OS) can run them.
+inline bool
+beckmannIsaSupported(int isa)
+{
+#ifdef PXRBECKMANN_MULTI_ISA
+    __builtin_cpu_init();
+    switch (isa)
+    {
+        case k_isaBaseline: return true;
+        case k_isaSse42:    return __builtin_cpu_supports("sse4.2");
+        case k_isaAvx2:     return __builtin_cpu_supports("avx2") &&
+                                   __builtin_cpu_supports("fma");
+        case k_isaAvx512:   return __builtin_cpu_supports("avx512f") &&
+                                   __builtin_cpu_supports("avx512vl") &&
+                                   __builtin_cpu_supports("avx512dq");
+        default:            return false;
+    }
+#else
+    return isa == k_isaBaseline;
+#endif
+}
+
+inline PxrBeckmannKernelTable const &
+beckmannKernelTable(int isa)
+{
+    static PxrBeckmannKernelTable const s_tables[k_numIsas] =
+    {
+        { k_isaBaseline, beckmannGenerateBlock, beckmannEvaluateBlock },
+#ifdef PXRBECKMANN_MULTI_ISA
+        { k_isaSse42, beckmannGenerateBlock_sse42, beckmannEvaluateBlock_sse42 },
+        { k_isaAvx2, beckmannGenerateBlock_avx2, beckmannEvaluateBlock_avx2 },
+        { k_isaAvx512, beckmannGenerateBlock_avx512, beckmannEvaluateBlock_avx512 }
+#else
+        { k_isaBaseline, beckmannGenerateBlock, beckmannEvaluateBlock },
+        { k_isaBaseline, beckmannGenerateBlock, beckmannEvaluateBlock },
+        { k_isaBaseline, beckmannGenerateBlock, beckmannEvaluateBlock }
+#endif
+    };
+    return s_tables[(isa >= 0 && isa < k_numIsas) ? isa : k_isaBaseline];
+}
+
+// The widest supported ISA, no wider than the one named by limit (eg. the
+// value of $PXRBECKMANN_ISA) when that is set. Unknown names are ignored.
+inline int
+beckmannSelectIsa(char const *limit = 0)
+{
+    int best = k_numIsas - 1;
+    if (limit && *limit)
+    {
+        for (int isa = 0; isa < k_numIsas; ++isa)
+        {
+            if (!std::strcmp(limit, beckmannIsaName(isa)))
+                best = isa;
+        }
+    }
+    while (best > k_isaBaseline && !beckmannIsaSupported(best))
+        --best;
+    return best;
+}
+
+// Runs every supported variant over the same blocks of every sampling mode,
+// distribution and reverse setting and returns the largest difference of
+// any output from the baseline, relative to max(1, |baseline|), or a
+// negative value if the mirror masks differ. Without FMA this is 0. With
+// it cos^2 of half vectors near the peak of narrow lobes rounds
+// differently and D, which is badly conditioned there, moves by up to
+// ~5e-3, so anything above 1e-2 points at a miscompiled variant.
+inline float
+beckmannCompareIsas(int numBlocks = 256)
+{
+    float worst = 0.f;
+    unsigned int state = 1;
+    for (int k = 0; k < numBlocks; ++k)
+    {
+        int samplingMode = (k & 1) ? k_sampleVisible : k_sampleNdf;
+        int distribution = (k >> 1) % k_numDistributions;
+        bool reverse = !(((k >> 1) / k_numDistributions) & 1);
+        PxrBeckmannSoABlock in;
+        for (int i = 0; i < k_soaBlockSize; ++i)
+        {
+            float u[6];
+            for (int j = 0; j < 6; ++j)
+            {
+                state = state * 1664525u + 1013904223u;
+                u[j] = (float) (state >> 8) * (1.f / 16777216.f);
+            }
+            float NdV = u[0];
+            float width = .01f + u[1];
+            float sinV = sqrtf(1.f - NdV*NdV);
+            in.index[i] = i;
+            in.Nx[i] = 0.f;  in.Ny[i] = 0.f;  in.Nz[i] = 1.f;
+            in.Vx[i] = sinV; in.Vy[i] = 0.f;  in.Vz[i] = NdV;
+            in.TXx[i] = 1.f; in.TXy[i] = 0.f; in.TXz[i] = 0.f;
+            in.TYx[i] = 0.f; in.TYy[i] = 1.f; in.TYz[i] = 0.f;
+            in.NdV[i] = NdV;
+            in.width[i] = width;
+            in.blend[i] = beckmannMin(1.f, 2.f * u[2]);
+            in.xi0[i] = u[3];
+            in.xi1[i] = u[4];
+            beckmannViewTerms(samplingMode, NdV, width, in.G1V[i],
+                              in.G1ExactV[i], in.invWidthSqrd[i], in.normD[i],
+                              distribution);
+        }
+
+        PxrBeckmannSoABlock ref = in;
+        beckmannKernelTable(k_isaBaseline).generate(ref, k_soaBlockSize,
+                                                    samplingMode, distribution,
+                                                    reverse);
+        PxrBeckmannSoABlock refEval = ref;
+        beckmannKernelTable(k_isaBaseline).evaluate(refEval, k_soaBlockSize,
+                                                    samplingMode, distribution,
+                                                    reverse);
+
+        for (int isa = k_isaBaseline + 1; isa < k_numIsas; ++isa)
+        {
+            if (!beckmannIsaSupported(isa))
+                continue;
+            PxrBeckmannKernelTable const &kernels = beckmannKernelTable(isa);
+            PxrBeckmannSoABlock gen = in;
+            kernels.generate(gen, k_soaBlockSize, samplingMode, distribution,
+                             reverse);
+            // evaluate the baseline's directions so the two stay comparable
+            PxrBeckmannSoABlock eval = ref;
+            kernels.evaluate(eval, k_soaBlockSize, samplingMode, distribution,
+                             reverse);
+
+            PxrBeckmannSoABlock const *a[2] = { &ref, &refEval };
+            PxrBeckmannSoABlock const *b[2] = { &gen, &eval };
+            for (int p = 0; p < 2; ++p)
+            {
+                for (int i = 0; i < k_soaBlockSize; ++i)
+                {
+                    if (a[p]->mirror[i] != b[p]->mirror[i])
+                        return -1.f;
+                    // a mask can flip right at a threshold, skip those lanes
+                    if (a[p]->valid[i] != b[p]->valid[i] || !a[p]->valid[i])
+                        continue;
+                    float x[6] = { a[p]->Lx[i], a[p]->Ly[i], a[p]->Lz[i],
+                                   a[p]->radiance[i], a[p]->FPdf[i], a[p]->RPdf[i] };
+                    float y[6] = { b[p]->Lx[i], b[p]->Ly[i], b[p]->Lz[i],
+                                   b[p]->radiance[i], b[p]->FPdf[i], b[p]->RPdf[i] };
+                    for (int j = 0; j < 6; ++j)
+                        worst = beckmannMax(worst, fabsf(x[j] - y[j]) /
+                                            beckmannMax(1.f, fabsf(x[j])));
+                }
+            }
+        }
+    }
+    return worst;
+}
+
+#endif
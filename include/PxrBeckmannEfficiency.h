@@ -0,0 +1,472 @@
+#ifndef PxrBeckmannEfficiency_h
+#define PxrBeckmannEfficiency_h
+//----------------------------------------------------------------------------------------------------------------------
+/// @file PxrBeckmannEfficiency.h
+/// @brief Monte Carlo measurement of how well the block kernels sample the
+/// lobe. What matters in production is time to converge, ie. the variance
+/// of W / FPdf times the time it takes to draw a sample, so this reports
+/// both along with the checks that the pdf is normalised. Renderer free like
+/// PxrBeckmannKernels.h; see the README for a driver.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include "PxrBeckmannKernels.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+struct PxrBeckmannEfficiency
+{
+    int samplingMode;
+    float width;
+    float NdV;
+    long long samples;
+    double pdfIntegral;     // FPdf over the sphere, 1 for visible normals,
+                            // 1 - P(V.m <= 0) for NDF sampling
+    double belowHorizon;    // fraction of samples wasted below the horizon
+    double mean;            // albedo estimate, E[W / FPdf]
+    double variance;        // per sample variance of W / FPdf
+    double nsPerSample;     // generate kernel time
+    double varianceTimeNs;  // variance * nsPerSample, lower is better
+};
+
+// Small xorshift generator so threads don't share any state.
+inline float
+beckmannEfficiencyRandom(unsigned long long &state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (float) (state >> 40) * (1.f / 16777216.f);
+}
+
+// Fills a block with one view direction at N = +z. blend is 1 so the mirror
+// lobe never steals samples.
+inline void
+beckmannEfficiencyBlock(PxrBeckmannSoABlock &b, int samplingMode,
+                        float width, float NdV,
+                        int distribution = k_distBeckmann)
+{
+    float sinV = sqrtf(beckmannMax(0.f, 1.f - NdV*NdV));
+    for (int i = 0; i < k_soaBlockSize; ++i)
+    {
+        b.index[i] = i;
+        b.Nx[i] = 0.f;  b.Ny[i] = 0.f;  b.Nz[i] = 1.f;
+        b.Vx[i] = sinV; b.Vy[i] = 0.f;  b.Vz[i] = NdV;
+        b.TXx[i] = 1.f; b.TXy[i] = 0.f; b.TXz[i] = 0.f;
+        b.TYx[i] = 0.f; b.TYy[i] = 1.f; b.TYz[i] = 0.f;
+        b.NdV[i] = NdV;
+        b.width[i] = width;
+        b.blend[i] = 1.f;
+        beckmannViewTerms(samplingMode, NdV, width, b.G1V[i], b.G1ExactV[i],
+                          b.invWidthSqrd[i], b.normD[i], distribution);
+    }
+}
+
+// Measures one (mode, width, NdV) cell with about numSamples samples of
+// each estimate. The pdf integral uses uniform directions, so it gets noisy
+// for widths well below .1 where the lobe covers little of the sphere.
+inline PxrBeckmannEfficiency
+beckmannMeasureEfficiency(int samplingMode, float width, float NdV,
+                          long long numSamples, unsigned long long seed)
+{
+    PxrBeckmannEfficiency e;
+    e.samplingMode = samplingMode;
+    e.width = width;
+    e.NdV = NdV = std::max(NdV, 2.f * k_minfacing);
+
+    unsigned long long state = seed * 0x9E3779B97F4A7C15ull + 1;
+    PxrBeckmannSoABlock b;
+    beckmannEfficiencyBlock(b, samplingMode, width, NdV);
+
+    long long numBlocks = (numSamples + k_soaBlockSize - 1) / k_soaBlockSize;
+    double sum = 0., sumSqrd = 0., pdfSum = 0.;
+    long long below = 0;
+    std::chrono::steady_clock::duration kernelTime(0);
+
+    for (long long k = 0; k < numBlocks; ++k)
+    {
+        for (int i = 0; i < k_soaBlockSize; ++i)
+        {
+            b.xi0[i] = beckmannEfficiencyRandom(state);
+            b.xi1[i] = beckmannEfficiencyRandom(state);
+        }
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        beckmannGenerateBlock(b, k_soaBlockSize, samplingMode);
+        kernelTime += std::chrono::steady_clock::now() - start;
+
+        for (int i = 0; i < k_soaBlockSize; ++i)
+        {
+            float OdN = b.Lz[i];
+            double f = 0.;
+            if (!b.valid[i] || OdN <= 0.f)
+                ++below;
+            else if (b.FPdf[i] > 0.f)
+                f = b.radiance[i] / b.FPdf[i];
+            sum += f;
+            sumSqrd += f * f;
+        }
+
+        // FPdf of uniformly distributed directions
+        for (int i = 0; i < k_soaBlockSize; ++i)
+        {
+            float z = 2.f * beckmannEfficiencyRandom(state) - 1.f;
+            float r = sqrtf(beckmannMax(0.f, 1.f - z*z));
+            float s, c;
+            beckmannSincos(2.f * (float) M_PI * beckmannEfficiencyRandom(state), s, c);
+            b.Lx[i] = r * c;
+            b.Ly[i] = r * s;
+            b.Lz[i] = z;
+        }
+        beckmannEvaluateBlock(b, k_soaBlockSize, samplingMode);
+        for (int i = 0; i < k_soaBlockSize; ++i)
+        {
+            // the pdf lives on half vectors facing both N and V
+            float mx = b.Lx[i] + b.Vx[i];
+            float my = b.Ly[i] + b.Vy[i];
+            float mz = b.Lz[i] + b.Vz[i];
+            float VdM = b.Vx[i]*mx + b.Vy[i]*my + b.Vz[i]*mz;
+            if (mz > 0.f && VdM > 0.f)
+                pdfSum += b.FPdf[i];
+        }
+    }
+
+    double n = (double) (numBlocks * k_soaBlockSize);
+    e.samples = numBlocks * k_soaBlockSize;
+    e.pdfIntegral = 4. * M_PI * pdfSum / n;
+    e.belowHorizon = below / n;
+    e.mean = sum / n;
+    e.variance = std::max(0., sumSqrd / n - e.mean * e.mean);
+    e.nsPerSample = std::chrono::duration<double, std::nano>(kernelTime).count() / n;
+    e.varianceTimeNs = e.variance * e.nsPerSample;
+    return e;
+}
+
+inline void
+beckmannEfficiencyCsvHeader(std::ostream &os)
+{
+    os << "mode,width,NdV,samples,pdfIntegral,belowHorizon,mean,variance,"
+          "nsPerSample,varianceTimeNs\n";
+}
+
+inline void
+beckmannEfficiencyCsvRow(std::ostream &os, PxrBeckmannEfficiency const &e)
+{
+    os << (e.samplingMode == k_sampleVisible ? "visible" : "ndf") << ','
+       << e.width << ',' << e.NdV << ',' << e.samples << ','
+       << e.pdfIntegral << ',' << e.belowHorizon << ',' << e.mean << ','
+       << e.variance << ',' << e.nsPerSample << ',' << e.varianceTimeNs << '\n';
+}
+
+// Measures every (mode, width, NdV) combination on numThreads threads and
+// writes one CSV row per cell, in a fixed order so runs can be diffed. Each
+// cell has its own seed, so the estimates don't depend on the thread count,
+// only the timings do.
+inline void
+beckmannEfficiencyCsv(std::ostream &os,
+                      std::vector<float> const &widths,
+                      std::vector<float> const &cosines,
+                      long long numSamples, int numThreads = 0)
+{
+    int modes[2] = { k_sampleNdf, k_sampleVisible };
+    int numCells = 2 * (int) (widths.size() * cosines.size());
+    std::vector<PxrBeckmannEfficiency> cells(numCells);
+
+    if (numThreads <= 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::atomic<int> next(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        threads.push_back(std::thread([&]()
+        {
+            for (int c = next++; c < numCells; c = next++)
+            {
+                int m = c / (int) (widths.size() * cosines.size());
+                int r = c % (int) (widths.size() * cosines.size());
+                cells[c] = beckmannMeasureEfficiency(modes[m],
+                                                     widths[r / cosines.size()],
+                                                     cosines[r % cosines.size()],
+                                                     numSamples, c + 1);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+
+    beckmannEfficiencyCsvHeader(os);
+    for (int c = 0; c < numCells; ++c)
+        beckmannEfficiencyCsvRow(os, cells[c]);
+}
+
+// What the simplified lobe (the simplifyIndirect and simplifySpread
+// parameters) saves and what it costs in accuracy for one (distribution,
+// width, NdV) cell. Both lobes reflect an environment 1 + L.R, R the
+// mirror direction, so the error shows how much of the lobe's shape the
+// cosine stand in loses; under uniform light the two agree up to the
+// error of the albedo table.
+struct PxrBeckmannSimplification
+{
+    int distribution;
+    float width;
+    float NdV;
+    double fullNs;          // generate time per sample of the full lobe
+    double simpleNs;        // and of the simplified one
+    double fullAlbedo;      // E[W / FPdf] of the full lobe
+    double simpleAlbedo;    // the albedo the simplified lobe carries
+    double fullRadiance;    // reflected 1 + L.R
+    double simpleRadiance;
+    double error;           // |simpleRadiance - fullRadiance| / fullRadiance
+};
+
+inline PxrBeckmannSimplification
+beckmannMeasureSimplification(int distribution, float width, float NdV,
+                              long long numSamples, unsigned long long seed)
+{
+    PxrBeckmannSimplification e;
+    e.distribution = distribution;
+    e.width = width;
+    e.NdV = NdV = std::max(NdV, 2.f * k_minfacing);
+    float Rx = -sqrtf(beckmannMax(0.f, 1.f - NdV*NdV));
+    float Rz = NdV;
+    float albedo = PxrBeckmannAlbedoTable::Integrate(width, NdV, distribution);
+
+    unsigned long long state = seed * 0x9E3779B97F4A7C15ull + 1;
+    PxrBeckmannSoABlock b;
+    beckmannEfficiencyBlock(b, k_sampleVisible, width, NdV, distribution);
+
+    long long numBlocks = (numSamples + k_soaBlockSize - 1) / k_soaBlockSize;
+    double fullSum = 0., fullRadiance = 0., simpleRadiance = 0.;
+    std::chrono::steady_clock::duration fullTime(0), simpleTime(0);
+
+    for (long long k = 0; k < numBlocks; ++k)
+    {
+        for (int i = 0; i < k_soaBlockSize; ++i)
+        {
+            b.xi0[i] = beckmannEfficiencyRandom(state);
+            b.xi1[i] = beckmannEfficiencyRandom(state);
+        }
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        beckmannGenerateBlock(b, k_soaBlockSize, k_sampleVisible, distribution);
+        fullTime += std::chrono::steady_clock::now() - start;
+        for (int i = 0; i < k_soaBlockSize; ++i)
+        {
+            if (!b.valid[i] || b.Lz[i] <= 0.f || b.FPdf[i] <= 0.f)
+                continue;
+            double f = b.radiance[i] / b.FPdf[i];
+            fullSum += f;
+            fullRadiance += f * (1. + b.Lx[i] * Rx + b.Lz[i] * Rz);
+        }
+
+        // the plugin's simplified generate, on the same xi
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < k_soaBlockSize; ++i)
+        {
+            float x, y, z;
+            beckmannSampleCosine(b.xi0[i], b.xi1[i], x, y, z);
+            b.Lx[i] = x;
+            b.Ly[i] = y;
+            b.Lz[i] = z;
+            b.FPdf[i] = z * (float) M_1_PI;
+            b.radiance[i] = albedo * b.FPdf[i];
+        }
+        simpleTime += std::chrono::steady_clock::now() - start;
+        for (int i = 0; i < k_soaBlockSize; ++i)
+        {
+            if (b.FPdf[i] <= 0.f)
+                continue;
+            double f = b.radiance[i] / b.FPdf[i];
+            simpleRadiance += f * (1. + b.Lx[i] * Rx + b.Lz[i] * Rz);
+        }
+    }
+
+    double n = (double) (numBlocks * k_soaBlockSize);
+    e.fullNs = std::chrono::duration<double, std::nano>(fullTime).count() / n;
+    e.simpleNs = std::chrono::duration<double, std::nano>(simpleTime).count() / n;
+    e.fullAlbedo = fullSum / n;
+    e.simpleAlbedo = albedo;
+    e.fullRadiance = fullRadiance / n;
+    e.simpleRadiance = simpleRadiance / n;
+    e.error = std::fabs(e.simpleRadiance - e.fullRadiance) /
+              std::max(e.fullRadiance, 1e-6);
+    return e;
+}
+
+// Measures every distribution over the given widths and cosines, one CSV
+// row per cell, on the calling thread so the timings don't contend.
+inline void
+beckmannSimplificationCsv(std::ostream &os,
+                          std::vector<float> const &widths,
+                          std::vector<float> const &cosines,
+                          long long numSamples)
+{
+    static char const *s_names[k_numDistributions] =
+    {
+        "beckmann", "blinnPhong", "ggx"
+    };
+    os << "distribution,width,NdV,fullNs,simpleNs,speedup,fullAlbedo,"
+          "simpleAlbedo,fullRadiance,simpleRadiance,error\n";
+    unsigned long long seed = 1;
+    for (int d = 0; d < k_numDistributions; ++d)
+    {
+        for (size_t w = 0; w < widths.size(); ++w)
+        {
+            for (size_t c = 0; c < cosines.size(); ++c)
+            {
+                PxrBeckmannSimplification e =
+                    beckmannMeasureSimplification(d, widths[w], cosines[c],
+                                                  numSamples, seed++);
+                os << s_names[d] << ',' << e.width << ',' << e.NdV << ','
+                   << e.fullNs << ',' << e.simpleNs << ','
+                   << e.fullNs / std::max(e.simpleNs, 1e-9) << ','
+                   << e.fullAlbedo << ',' << e.simpleAlbedo << ','
+                   << e.fullRadiance << ',' << e.simpleRadiance << ','
+                   << e.error << '\n';
+            }
+        }
+    }
+}
+
+// Time per sample of the block kernels with and without the reverse pdf,
+// for every call type, distribution and sampling mode, standing in for the
+// plugin's calls with a fixed shading context: one view direction per
+// block at width .3 and NdV .5. Writes one CSV row per combination:
+//   call, distribution, mode, ns with RPdf, ns without, saving (fraction)
+inline void
+beckmannReversePdfCsv(std::ostream &os, long long numSamples)
+{
+    static char const *s_names[k_numDistributions] =
+    {
+        "beckmann", "blinnPhong", "ggx"
+    };
+    int modes[2] = { k_sampleNdf, k_sampleVisible };
+    long long numBlocks = (numSamples + k_soaBlockSize - 1) / k_soaBlockSize;
+    std::atomic<int> sink(0); // keeps the kernels from being optimised out
+
+    os << "call,distribution,mode,reverseNs,forwardNs,saving\n";
+    for (int call = 0; call < 2; ++call)
+    {
+        for (int d = 0; d < k_numDistributions; ++d)
+        {
+            for (int m = 0; m < 2; ++m)
+            {
+                double ns[2];
+                for (int reverse = 1; reverse >= 0; --reverse)
+                {
+                    PxrBeckmannSoABlock b;
+                    beckmannEfficiencyBlock(b, modes[m], .3f, .5f, d);
+                    unsigned long long state = 1;
+                    for (int i = 0; i < k_soaBlockSize; ++i)
+                    {
+                        b.xi0[i] = beckmannEfficiencyRandom(state);
+                        b.xi1[i] = beckmannEfficiencyRandom(state);
+                    }
+                    // evaluate the generated directions
+                    beckmannGenerateBlock(b, k_soaBlockSize, modes[m], d);
+
+                    int valid = 0;
+                    std::chrono::steady_clock::time_point start =
+                        std::chrono::steady_clock::now();
+                    for (long long k = 0; k < numBlocks; ++k)
+                    {
+                        if (call == 0)
+                            beckmannGenerateBlock(b, k_soaBlockSize, modes[m], d,
+                                                  reverse != 0);
+                        else
+                            beckmannEvaluateBlock(b, k_soaBlockSize, modes[m], d,
+                                                  reverse != 0);
+                        valid += b.valid[k & (k_soaBlockSize - 1)];
+                    }
+                    ns[reverse] = std::chrono::duration<double, std::nano>(
+                                      std::chrono::steady_clock::now() - start).count() /
+                                  (double) (numBlocks * k_soaBlockSize);
+                    sink += valid;
+                }
+                os << (call == 0 ? "generate" : "evaluate") << ','
+                   << s_names[d] << ','
+                   << (modes[m] == k_sampleVisible ? "visible" : "ndf") << ','
+                   << ns[1] << ',' << ns[0] << ',' << 1. - ns[0] / ns[1] << '\n';
+            }
+        }
+    }
+}
+
+// Thread scaling of the block kernels. Every thread shades its own blocks
+// with its own random state, standing in for a shading context per thread,
+// so any loss of efficiency comes from shared state, false sharing or
+// memory bandwidth rather than from the work itself. Writes one CSV row per
+// thread count, doubling up to maxThreads:
+//   threads, Msamples/s, efficiency = throughput / (threads * 1 thread)
+inline void
+beckmannThreadScalingCsv(std::ostream &os, int maxThreads,
+                         long long samplesPerThread,
+                         int samplingMode = k_sampleVisible)
+{
+    if (maxThreads <= 0)
+        maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<int> counts;
+    for (int n = 1; n < maxThreads; n *= 2)
+        counts.push_back(n);
+    counts.push_back(maxThreads);
+
+    os << "threads,msamplesPerSecond,efficiency\n";
+    double single = 0.;
+    for (size_t c = 0; c < counts.size(); ++c)
+    {
+        int numThreads = counts[c];
+        long long numBlocks = samplesPerThread / k_soaBlockSize;
+        std::atomic<int> ready(0);
+        std::atomic<bool> go(false);
+        std::atomic<int> sink(0); // keeps the kernels from being optimised out
+        std::vector<std::thread> threads;
+        for (int t = 0; t < numThreads; ++t)
+        {
+            threads.push_back(std::thread([&, t]()
+            {
+                PxrBeckmannSoABlock b;
+                beckmannEfficiencyBlock(b, samplingMode, .3f, .5f);
+                unsigned long long state = (t + 1) * 0x9E3779B97F4A7C15ull;
+                ++ready;
+                while (!go)
+                    std::this_thread::yield();
+                int valid = 0;
+                for (long long k = 0; k < numBlocks; ++k)
+                {
+                    for (int i = 0; i < k_soaBlockSize; ++i)
+                    {
+                        b.xi0[i] = beckmannEfficiencyRandom(state);
+                        b.xi1[i] = beckmannEfficiencyRandom(state);
+                    }
+                    beckmannGenerateBlock(b, k_soaBlockSize, samplingMode);
+                    beckmannEvaluateBlock(b, k_soaBlockSize, samplingMode);
+                    valid += b.valid[k & (k_soaBlockSize - 1)];
+                }
+                sink += valid;
+            }));
+        }
+        while (ready < numThreads)
+            std::this_thread::yield();
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        go = true;
+        for (size_t t = 0; t < threads.size(); ++t)
+            threads[t].join();
+        double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start).count();
+
+        double rate = numThreads * numBlocks * k_soaBlockSize / seconds;
+        if (c == 0)
+            single = rate;
+        os << numThreads << ',' << rate * 1e-6 << ','
+           << rate / (numThreads * single) << '\n';
+    }
+}
+
+#endif
@@ -0,0 +1,1280 @@
+#ifndef PxrBeckmannKernels_h
+#define PxrBeckmannKernels_h
+//----------------------------------------------------------------------------------------------------------------------
+/// @file PxrBeckmannKernels.h
+/// @brief Renderer independent microfacet NDF, shadowing and sampling kernels.
+/// Only depends on the C++ standard library so the math behind PxrBeckmann
+/// can be built, profiled and checked on machines without RMANTREE. The
+/// plugin gathers its shading grids into PxrBeckmannSoABlock's and calls
+/// the block kernels below, which are templated on an NDF policy (Beckmann,
+/// Blinn-Phong or GGX) so every distribution shares the same loops.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <cmath>
+#include <vector>
+#include "PxrBeckmannMath.h"
+
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+
+static const float k_minfacing = .0001f; // NdV < k_minfacing is invalid
+
+// For the few policy functions that are too big for gcc's inlining
+// heuristics. The lane loops only vectorise once every call in them has
+// been inlined.
+#if defined(__GNUC__) || defined(__clang__)
+    #define PXRBECKMANN_FORCE_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+    #define PXRBECKMANN_FORCE_INLINE __forceinline
+#else
+    #define PXRBECKMANN_FORCE_INLINE inline
+#endif
+
+// Grid entry points are shaded in structure-of-arrays blocks of
+// k_soaBlockSize lanes. The block kernels below are branch free: the
+// k_minfacing, NdL, cosTheta and G1/G2 tests become lane masks so that each
+// loop maps onto 8 (AVX2) or 16 (AVX-512) wide registers. Results agree
+// with the scalar beckmannEvaluateReference to within 5e-4 relative error,
+// the only difference being that RPdf is 0 rather than -0 or NaN when the
+// sampled direction lands at or below the horizon.
+static const int k_soaBlockSize = 64; // a multiple of 16 lanes
+
+struct PxrBeckmannSoABlock
+{
+    int   index[k_soaBlockSize];   // grid point of each lane
+    int   valid[k_soaBlockSize];   // lane mask written by the kernels
+    float Nx[k_soaBlockSize], Ny[k_soaBlockSize], Nz[k_soaBlockSize];
+    float Vx[k_soaBlockSize], Vy[k_soaBlockSize], Vz[k_soaBlockSize];
+    float Lx[k_soaBlockSize], Ly[k_soaBlockSize], Lz[k_soaBlockSize];
+    float TXx[k_soaBlockSize], TXy[k_soaBlockSize], TXz[k_soaBlockSize];
+    float TYx[k_soaBlockSize], TYy[k_soaBlockSize], TYz[k_soaBlockSize];
+    float NdV[k_soaBlockSize];
+    float width[k_soaBlockSize];
+    // view dependent terms, see beckmannViewTerms
+    float G1V[k_soaBlockSize];          // backend Smith G1 of V
+    float G1ExactV[k_soaBlockSize];     // exact Smith G1 of V
+    float invWidthSqrd[k_soaBlockSize]; // 1 / width^2
+    float normD[k_soaBlockSize];        // 1 / (pi width^2)
+    float xi0[k_soaBlockSize], xi1[k_soaBlockSize];
+    float blend[k_soaBlockSize];   // microfacet share, see beckmannMirrorBlend
+    int   mirror[k_soaBlockSize];  // lane sampled the discrete mirror lobe
+    float radiance[k_soaBlockSize];
+    float FPdf[k_soaBlockSize], RPdf[k_soaBlockSize];
+};
+
+// Smith G1 shadowing term for the Beckmann NDF. All of the backends are
+// functions of a = cosV / (width * sinV) only and are written with selects,
+// so the a >= 1.6 and cosV <= 0 cases stay in the lane. Pick one at compile
+// time with PXRBECKMANN_G1_BACKEND. Max abs error against the exact term:
+//   PXRBECKMANN_G1_RATIONAL  Walter et al. rational fit      3.2e-3
+//   PXRBECKMANN_G1_EXACT     erf based Smith term            (reference)
+//   PXRBECKMANN_G1_TABLE     65 entry table, linear interp   1.6e-4
+#define PXRBECKMANN_G1_RATIONAL 0
+#define PXRBECKMANN_G1_EXACT    1
+#define PXRBECKMANN_G1_TABLE    2
+
+#ifndef PXRBECKMANN_G1_BACKEND
+    #define PXRBECKMANN_G1_BACKEND PXRBECKMANN_G1_RATIONAL
+#endif
+
+// Exact G1 sampled at u = a / (a + 0.5), which spreads the entries over
+// the part of the curve near grazing where it bends the most.
+static const int k_beckmannG1TableSize = 64;
+static const float k_beckmannG1Table[k_beckmannG1TableSize + 1] =
+{
+    0.0000000f, 0.0277422f, 0.0555728f, 0.0834809f, 0.1114548f, 0.1394819f,
+    0.1675486f, 0.1956401f, 0.2237407f, 0.2518333f, 0.2798999f, 0.3079207f,
+    0.3358749f, 0.3637401f, 0.3914925f, 0.4191063f, 0.4465545f, 0.4738081f,
+    0.5008362f, 0.5276061f, 0.5540832f, 0.5802307f, 0.6060099f, 0.6313801f,
+    0.6562983f, 0.6807195f, 0.7045967f, 0.7278811f, 0.7505218f, 0.7724665f,
+    0.7936614f, 0.8140519f, 0.8335826f, 0.8521979f, 0.8698433f, 0.8864654f,
+    0.9020135f, 0.9164406f, 0.9297050f, 0.9417720f, 0.9526159f, 0.9622223f,
+    0.9705906f, 0.9777365f, 0.9836951f, 0.9885227f, 0.9922989f, 0.9951274f,
+    0.9971339f, 0.9984625f, 0.9992672f, 0.9997008f, 0.9999008f, 0.9999752f,
+    0.9999959f, 0.9999996f, 1.0000000f, 1.0000000f, 1.0000000f, 1.0000000f,
+    1.0000000f, 1.0000000f, 1.0000000f, 1.0000000f, 1.0000000f
+};
+
+inline float
+beckmannG1Rational(float cosV, float sinV, float width)
+{
+    float a = cosV / (width * sinV);
+    float g = (3.535f*a + 2.181f*a*a) / (1.f + 2.276f*a + 2.577f*a*a);
+    return (a < 1.6f) ? g : 1.f;
+}
+
+inline float
+beckmannG1Exact(float cosV, float sinV, float width)
+{
+    float a = cosV / (width * sinV);
+    // 1.7724539 is sqrt(pi)
+    return 2.f / (1.f + beckmannErf(a) + beckmannExp(-a*a) / (a * 1.7724539f));
+}
+
+inline float
+beckmannG1Table(float cosV, float sinV, float width)
+{
+    float f = k_beckmannG1TableSize * cosV / (cosV + .5f * width * sinV);
+    f = beckmannMax(f, 0.f); // keep the load in range for cosV <= 0 lanes
+    int i = (int) f;
+    i = (i < k_beckmannG1TableSize - 1) ? i : k_beckmannG1TableSize - 1;
+    float t = f - (float) i;
+    return k_beckmannG1Table[i] +
+           t * (k_beckmannG1Table[i + 1] - k_beckmannG1Table[i]);
+}
+
+inline float
+beckmannG1(float cosV, float width)
+{
+    float sinV = sqrtf(beckmannMax(0.f, 1.f - cosV*cosV));
+#if PXRBECKMANN_G1_BACKEND == PXRBECKMANN_G1_EXACT
+    float g = beckmannG1Exact(cosV, sinV, width);
+#elif PXRBECKMANN_G1_BACKEND == PXRBECKMANN_G1_TABLE
+    float g = beckmannG1Table(cosV, sinV, width);
+#else
+    float g = beckmannG1Rational(cosV, sinV, width);
+#endif
+    return (cosV > 0.f) ? g : 0.f;
+}
+
+// Near-specular mode. As width goes to 0 the lobe becomes a mirror whose
+// D and 1/(width^2 cos^4) factors over/underflow and whose weights have
+// huge variance. Below mirrorWidth the BxDF is a discrete mirror lobe;
+// over the following mirrorBand it is a blend of mirror and microfacet
+// lobes, the returned value being the share of the microfacet lobe.
+// Sampling picks the mirror with probability 1 - blend so the pair stays
+// energy consistent with the blended BxDF.
+inline float
+beckmannMirrorBlend(float width, float mirrorWidth, float mirrorBand)
+{
+    float t = (width - mirrorWidth) / beckmannMax(mirrorBand, 1e-20f);
+    return beckmannClamp(t, 0.f, 1.f);
+}
+
+// Half vector sampling strategies, selected with the samplingMode
+// parameter. k_sampleNdf draws m from D(m) cos(m); k_sampleVisible draws
+// it from the distribution of normals visible from V (Heitz and d'Eon
+// 2014), so far fewer reflected directions end up below the horizon and
+// W / FPdf reduces to the light side shadowing term.
+enum PxrBeckmannSamplingMode
+{
+    k_sampleNdf = 0,
+    k_sampleVisible = 1
+};
+
+// Single precision inverse error function (Giles 2010). Both branches are
+// evaluated and selected so the sampling loops stay free of control flow.
+inline float
+beckmannErfInv(float x)
+{
+    float w = -beckmannLog((1.f - x) * (1.f + x));
+
+    float wc = w - 2.5f;
+    float p = 2.81022636e-08f;
+    p = 3.43273939e-07f + p*wc;
+    p = -3.5233877e-06f + p*wc;
+    p = -4.39150654e-06f + p*wc;
+    p = 0.00021858087f + p*wc;
+    p = -0.00125372503f + p*wc;
+    p = -0.00417768164f + p*wc;
+    p = 0.246640727f + p*wc;
+    p = 1.50140941f + p*wc;
+
+    float wt = sqrtf(beckmannMax(w, 5.f)) - 3.f;
+    float q = -0.000200214257f;
+    q = 0.000100950558f + q*wt;
+    q = 0.00134934322f + q*wt;
+    q = -0.00367342844f + q*wt;
+    q = 0.00573950773f + q*wt;
+    q = -0.0076224613f + q*wt;
+    q = 0.00943887047f + q*wt;
+    q = 1.00167406f + q*wt;
+    q = 2.83297682f + q*wt;
+
+    return ((w < 5.f) ? p : q) * x;
+}
+
+// One bisection guarded Newton step of beckmannSampleVisibleSlopes, solving
+// CDF(b) = u1 for b = erf(slope) in the bracket [a, c].
+inline void
+beckmannVisibleNewtonStep(float u1, float tanThetaI, float norm,
+                          float &a, float &b, float &c)
+{
+    const float k_invSqrtPi = 0.56418958f;
+    b = (b >= a && b <= c) ? b : .5f * (a + c);
+    float invErf = beckmannErfInv(b);
+    float value = norm * (1.f + b + k_invSqrtPi * tanThetaI *
+                          beckmannExp(-invErf * invErf)) - u1;
+    // >= 0 inside the bracket, 0 only at its top end
+    float derivative = norm * beckmannMax(1.f - invErf * tanThetaI, 1e-6f);
+    c = (value > 0.f) ? b : c;
+    a = (value > 0.f) ? a : b;
+    b -= value / derivative;
+}
+
+// Samples the slopes of the visible normals of a unit width Beckmann
+// surface seen at cosThetaI, for a view direction along +x. The slope along
+// x comes from inverting its CDF with two bisection guarded Newton steps,
+// the slope along y is an independent normal variate. Branch free, so the
+// lane loops that call it vectorise.
+inline void
+beckmannSampleVisibleSlopes(float cosThetaI, float u1, float u2,
+                            float &slopeX, float &slopeY)
+{
+    const float k_invSqrtPi = 0.56418958f;
+    u1 = beckmannMax(u1, 1e-6f);
+    u2 = beckmannMax(u2, 1e-6f);
+
+    // normal incidence, visible and plain slopes coincide
+    float r = sqrtf(-beckmannLog(1.f - u1));
+    float sinPhi, cosPhi;
+    beckmannSincos(2.f * (float) M_PI * u2, sinPhi, cosPhi);
+    bool normal = cosThetaI > .9999f;
+
+    float cosI = beckmannMin(cosThetaI, .9999f);
+    float sinThetaI = sqrtf(1.f - cosI*cosI);
+    float tanThetaI = sinThetaI / cosI;
+    float cotThetaI = cosI / sinThetaI;
+    // acos, Abramowitz and Stegun 4.4.45, only used by the start fit
+    float poly = -.2121144f + cosI * (.0742610f - .0187293f * cosI);
+    float thetaI = sqrtf(1.f - cosI) * (1.5707288f + cosI * poly);
+
+    float a = -1.f;
+    float c = beckmannErf(cotThetaI);
+    float fit = 1.f + thetaI * (-.876f + thetaI * (.4265f - .0594f * thetaI));
+    float b = c - (1.f + c) * beckmannExp(fit * beckmannLog(1.f - u1));
+    float norm = 1.f / (1.f + c + k_invSqrtPi * tanThetaI *
+                                  beckmannExp(-cotThetaI * cotThetaI));
+
+    // From the fitted start the CDF residual is below 2e-3 after one step
+    // and 3e-6 after two, which is all single precision has to give. Written
+    // out rather than looped so gcc vectorises the caller's lane loop.
+    beckmannVisibleNewtonStep(u1, tanThetaI, norm, a, b, c);
+    beckmannVisibleNewtonStep(u1, tanThetaI, norm, a, b, c);
+    b = (b >= a && b <= c) ? b : .5f * (a + c);
+
+    slopeX = normal ? r * cosPhi : beckmannErfInv(b);
+    slopeY = normal ? r * sinPhi : beckmannErfInv(2.f * u2 - 1.f);
+}
+
+// Samples a half vector in the local (TX, TY, N) frame.
+inline void
+beckmannSampleNdf(float width, float u1, float u2,
+                  float &x, float &y, float &z)
+{
+    float cosThetaSqrd = 1.f / (1.f - width * width * beckmannLog(1.f - u1));
+    float sinTheta = sqrtf(beckmannMax(0.f, 1.f - cosThetaSqrd));
+    float sinPhi, cosPhi;
+    beckmannSincos(u2 * 2.f * (float) M_PI, sinPhi, cosPhi);
+    x = sinTheta * cosPhi;
+    y = sinTheta * sinPhi;
+    z = sqrtf(cosThetaSqrd);
+}
+
+// Samples a visible half vector in the local (TX, TY, N) frame for the
+// local view direction (vx, vy, vz): stretch to unit width, sample the
+// slopes, rotate them to the view azimuth and unstretch.
+inline void
+beckmannSampleVisible(float width, float vx, float vy, float vz,
+                      float u1, float u2, float &x, float &y, float &z)
+{
+    float sx = width * vx;
+    float sy = width * vy;
+    float invLen = 1.f / sqrtf(sx*sx + sy*sy + vz*vz);
+    float cosThetaI = vz * invLen;
+    float sinThetaI = sqrtf(sx*sx + sy*sy) * invLen;
+    float cosPhi = (sinThetaI > 0.f) ? sx * invLen / sinThetaI : 1.f;
+    float sinPhi = (sinThetaI > 0.f) ? sy * invLen / sinThetaI : 0.f;
+
+    float slopeX, slopeY;
+    beckmannSampleVisibleSlopes(cosThetaI, u1, u2, slopeX, slopeY);
+
+    float tx = width * (cosPhi * slopeX - sinPhi * slopeY);
+    float ty = width * (sinPhi * slopeX + cosPhi * slopeY);
+    float invNorm = 1.f / sqrtf(tx*tx + ty*ty + 1.f);
+    x = -tx * invNorm;
+    y = -ty * invNorm;
+    z = invNorm;
+}
+
+// Solid angle density of reflecting about a half vector with NdF = cosM,
+// D(m) = D, seen from a direction at cosine cosV to N and cosine VdM to m.
+// The reverse density is the same call with the light side cosines.
+inline float
+beckmannPdf(int samplingMode, float D, float cosM, float cosV, float VdM,
+            float width)
+{
+    if (samplingMode == k_sampleVisible)
+    {
+        float sinV = sqrtf(beckmannMax(0.f, 1.f - cosV*cosV));
+        float G1 = beckmannG1Exact(cosV, sinV, width);
+        return (cosV > 0.f) ? D * G1 / (4.f * cosV) : 0.f;
+    }
+    return D * cosM / (4.f * VdM);
+}
+
+// Distributions, selected with the distribution parameter. Each has an NDF
+// policy below that the block kernels are instantiated with.
+enum PxrBeckmannDistribution
+{
+    k_distBeckmann = 0,
+    k_distBlinnPhong = 1,
+    k_distGgx = 2,
+    k_numDistributions
+};
+
+// An NDF policy provides, all as static inline functions of the width
+// (alpha) and the view terms:
+//   NormD(invWidthSqrd)       constant factor of D, cached per point
+//   D(cos^2 m, invWidthSqrd, normD)
+//   G1(cosV, width)           Smith G1 = 1 / (1 + Lambda) used in weights
+//   G1Exact(cosV, width)      the one that normalises the visible normals
+//   SampleNdf(width, u1, u2, x, y, z)
+//   SampleVisible(width, vx, vy, vz, u1, u2, x, y, z)
+// and k_visibleSampling, false if it has no visible normal sampler, in
+// which case the kernels fall back to k_sampleNdf.
+struct PxrBeckmannNdf
+{
+    static const bool k_visibleSampling = true;
+
+    static float NormD(float invWidthSqrd)
+    {
+        return invWidthSqrd * (float) (1.0 / M_PI);
+    }
+
+    static float D(float cosThetaSqrd, float invWidthSqrd, float normD)
+    {
+        float invCos2 = 1.f / cosThetaSqrd;
+        return beckmannExp((cosThetaSqrd - 1.f) * invWidthSqrd * invCos2) *
+               normD * invCos2 * invCos2;
+    }
+
+    static float G1(float cosV, float width) { return beckmannG1(cosV, width); }
+
+    static float G1Exact(float cosV, float width)
+    {
+        float sinV = sqrtf(beckmannMax(0.f, 1.f - cosV*cosV));
+        return (cosV > 0.f) ? beckmannG1Exact(cosV, sinV, width) : 0.f;
+    }
+
+    static void SampleNdf(float width, float u1, float u2,
+                          float &x, float &y, float &z)
+    {
+        beckmannSampleNdf(width, u1, u2, x, y, z);
+    }
+
+    static void SampleVisible(float width, float vx, float vy, float vz,
+                              float u1, float u2, float &x, float &y, float &z)
+    {
+        beckmannSampleVisible(width, vx, vy, vz, u1, u2, x, y, z);
+    }
+};
+
+// 6 point Gauss-Legendre nodes and weights on [0, 1], for the Blinn-Phong
+// Smith integral below.
+static const int k_blinnPhongG1Nodes = 6;
+static const float k_blinnPhongG1X[k_blinnPhongG1Nodes] =
+{
+    0.0337652f, 0.1693953f, 0.3806904f, 0.6193096f, 0.8306047f, 0.9662348f
+};
+static const float k_blinnPhongG1W[k_blinnPhongG1Nodes] =
+{
+    0.0856622f, 0.1803808f, 0.2339570f, 0.2339570f, 0.1803808f, 0.0856622f
+};
+
+// Blinn-Phong with exponent e = 2 / width^2, which gives its slopes the
+// variance of the same Beckmann width and stays a distribution for every
+// width. Its slopes have longer tails than Beckmann's, so the Beckmann G1
+// undershadows them and the lobe gains energy near grazing; it has its
+// own Smith term instead. With p = e / 2 and
+// k = Gamma(p + 1/2) / (2 sqrt(pi) Gamma(p + 1)),
+//   Lambda = k / cosV int_cosV^1 (1 - cosV^2 / r^2)^p dr
+//          = k (1 + sum_j>0 (-1)^(j+1) C(p, j) cosV^2j / (2j - 1)) / cosV - 1/2
+// The integral is done with 6 point Gauss-Legendre, which misses the steep
+// rise of the integrand near grazing, where the series converges quickly
+// instead; both are evaluated and selected. G1 is within 7e-5 relative of
+// the exact term. There is no closed form visible normal sampler, so it
+// always samples the NDF.
+struct PxrBlinnPhongNdf
+{
+    static const bool k_visibleSampling = false;
+
+    static float Exponent(float invWidthSqrd) { return 2.f * invWidthSqrd; }
+
+    static float NormD(float invWidthSqrd)
+    {
+        return (Exponent(invWidthSqrd) + 2.f) * (float) (.5 / M_PI);
+    }
+
+    // normD cos^e m, taken as (cos^2 m)^(e / 2)
+    static float D(float cosThetaSqrd, float invWidthSqrd, float normD)
+    {
+        return normD * beckmannExp(.5f * Exponent(invWidthSqrd) *
+                                   beckmannLog(cosThetaSqrd));
+    }
+
+    PXRBECKMANN_FORCE_INLINE static float G1(float cosV, float width)
+    {
+        float p = 1.f / (width * width);
+        float cos2 = cosV * cosV;
+
+        // Gamma(x + 1/2) / Gamma(x + 1) from its asymptotic series at
+        // x = p + 4, brought down to p with the recurrence
+        float x = p + 4.f, ix = 1.f / x;
+        float ratio = 1.f + ix * (-.125f + ix * (.0078125f +
+                            ix * (.0048828125f - .00064086914f * ix)));
+        ratio /= sqrtf(x);
+        ratio *= (p + 1.f) * (p + 2.f) * (p + 3.f) * (p + 4.f) /
+                 ((p + .5f) * (p + 1.5f) * (p + 2.5f) * (p + 3.5f));
+        float k = ratio * (float) (.5 / 1.7724538509055160); // sqrt(pi)
+
+        // Series, for cosV sqrt(max(p, 1)) < .8
+        float term = p * cos2;
+        float series = term;
+        term *= -(p - 1.f) * cos2 * (1.f / 2.f); series += term * (1.f / 3.f);
+        term *= -(p - 2.f) * cos2 * (1.f / 3.f); series += term * (1.f / 5.f);
+        term *= -(p - 3.f) * cos2 * (1.f / 4.f); series += term * (1.f / 7.f);
+        term *= -(p - 4.f) * cos2 * (1.f / 5.f); series += term * (1.f / 9.f);
+        term *= -(p - 5.f) * cos2 * (1.f / 6.f); series += term * (1.f / 11.f);
+        float grazing = k * (1.f + series) / cosV - .5f;
+
+        // Quadrature, written out rather than looped so gcc vectorises the
+        // caller's lane loop.
+        float sum = G1Node(cosV, p, 0) + G1Node(cosV, p, 1) +
+                    G1Node(cosV, p, 2) + G1Node(cosV, p, 3) +
+                    G1Node(cosV, p, 4) + G1Node(cosV, p, 5);
+        float quadrature = k * (1.f - cosV) * sum / cosV;
+
+        bool nearGrazing = cosV * sqrtf(beckmannMax(p, 1.f)) < .8f;
+        float lambda = nearGrazing ? grazing : quadrature;
+        return (cosV > 0.f) ? 1.f / (1.f + lambda) : 0.f;
+    }
+
+    // Weighted integrand of Lambda at Gauss-Legendre node j
+    static float G1Node(float cosV, float p, int j)
+    {
+        float r = cosV + (1.f - cosV) * k_blinnPhongG1X[j];
+        float t = beckmannMax(1.f - cosV * cosV / (r * r), 1e-30f);
+        return k_blinnPhongG1W[j] * beckmannExp(p * beckmannLog(t));
+    }
+
+    static float G1Exact(float cosV, float width) { return G1(cosV, width); }
+
+    static void SampleNdf(float width, float u1, float u2,
+                          float &x, float &y, float &z)
+    {
+        // cos m = (1 - u1)^(1 / (e + 2))
+        float e = Exponent(1.f / (width * width));
+        float cosThetaSqrd =
+            beckmannExp(2.f * beckmannLog(1.f - u1) / (e + 2.f));
+        float sinTheta = sqrtf(beckmannMax(0.f, 1.f - cosThetaSqrd));
+        float sinPhi, cosPhi;
+        beckmannSincos(u2 * 2.f * (float) M_PI, sinPhi, cosPhi);
+        x = sinTheta * cosPhi;
+        y = sinTheta * sinPhi;
+        z = sqrtf(cosThetaSqrd);
+    }
+
+    static void SampleVisible(float width, float, float, float,
+                              float u1, float u2, float &x, float &y, float &z)
+    {
+        SampleNdf(width, u1, u2, x, y, z);
+    }
+};
+
+// GGX / Trowbridge-Reitz (Walter et al. 2007), with Heitz's 2018 closed
+// form visible normal sampler. Its G1 is exact and cheap, so both G1s are
+// the same function.
+struct PxrGgxNdf
+{
+    static const bool k_visibleSampling = true;
+
+    static float NormD(float invWidthSqrd)
+    {
+        return invWidthSqrd * (float) (1.0 / M_PI);
+    }
+
+    // alpha^2 / (pi ((alpha^2 - 1) cos^2 m + 1)^2), divided through by alpha^4
+    static float D(float cosThetaSqrd, float invWidthSqrd, float normD)
+    {
+        float t = cosThetaSqrd + (1.f - cosThetaSqrd) * invWidthSqrd;
+        return normD / (t * t);
+    }
+
+    static float G1(float cosV, float width)
+    {
+        float a2 = width * width;
+        float g = 2.f * cosV / (cosV + sqrtf(a2 + (1.f - a2) * cosV*cosV));
+        return (cosV > 0.f) ? g : 0.f;
+    }
+
+    static float G1Exact(float cosV, float width) { return G1(cosV, width); }
+
+    static void SampleNdf(float width, float u1, float u2,
+                          float &x, float &y, float &z)
+    {
+        // tan^2 m = alpha^2 u1 / (1 - u1)
+        float a2 = width * width;
+        float cosThetaSqrd = (1.f - u1) / (1.f - u1 + a2 * u1);
+        float sinTheta = sqrtf(beckmannMax(0.f, 1.f - cosThetaSqrd));
+        float sinPhi, cosPhi;
+        beckmannSincos(u2 * 2.f * (float) M_PI, sinPhi, cosPhi);
+        x = sinTheta * cosPhi;
+        y = sinTheta * sinPhi;
+        z = sqrtf(cosThetaSqrd);
+    }
+
+    // Stretch V to unit roughness, sample the projected disk of the
+    // hemisphere around it and unstretch.
+    static void SampleVisible(float width, float vx, float vy, float vz,
+                              float u1, float u2, float &x, float &y, float &z)
+    {
+        float hx = width * vx, hy = width * vy, hz = vz;
+        float invLen = 1.f / sqrtf(hx*hx + hy*hy + hz*hz);
+        hx *= invLen; hy *= invLen; hz *= invLen;
+
+        float lenSqrd = hx*hx + hy*hy;
+        float invLenXY = 1.f / sqrtf(beckmannMax(lenSqrd, 1e-20f));
+        float t1x = (lenSqrd > 0.f) ? -hy * invLenXY : 1.f;
+        float t1y = (lenSqrd > 0.f) ? hx * invLenXY : 0.f;
+        // T2 = H x T1
+        float t2x = -hz * t1y;
+        float t2y = hz * t1x;
+        float t2z = hx * t1y - hy * t1x;
+
+        float r = sqrtf(u1);
+        float sinPhi, cosPhi;
+        beckmannSincos(u2 * 2.f * (float) M_PI, sinPhi, cosPhi);
+        float p1 = r * cosPhi;
+        float p2 = r * sinPhi;
+        float s = .5f * (1.f + hz);
+        p2 = (1.f - s) * sqrtf(beckmannMax(0.f, 1.f - p1*p1)) + s * p2;
+        float p3 = sqrtf(beckmannMax(0.f, 1.f - p1*p1 - p2*p2));
+
+        float nx = p1 * t1x + p2 * t2x + p3 * hx;
+        float ny = p1 * t1y + p2 * t2y + p3 * hy;
+        float nz = p2 * t2z + p3 * hz;
+        nx *= width;
+        ny *= width;
+        nz = beckmannMax(nz, 0.f);
+        float invNorm = 1.f / sqrtf(nx*nx + ny*ny + nz*nz);
+        x = nx * invNorm;
+        y = ny * invNorm;
+        z = nz * invNorm;
+    }
+};
+
+// beckmannPdf for any NDF policy.
+template <class Ndf>
+inline float
+beckmannPdfT(int samplingMode, float D, float cosM, float cosV, float VdM,
+             float width)
+{
+    if (samplingMode == k_sampleVisible)
+    {
+        float G1 = Ndf::G1Exact(cosV, width);
+        return (cosV > 0.f) ? D * G1 / (4.f * cosV) : 0.f;
+    }
+    return D * cosM / (4.f * VdM);
+}
+
+// Terms that only depend on the view direction and width of a point. The
+// renderer shades the same point many times (BSDF samples, light samples)
+// so callers compute these once per point and gather them into blocks.
+template <class Ndf>
+inline void
+beckmannViewTermsT(int samplingMode, float NdV, float width,
+                   float &G1V, float &G1ExactV,
+                   float &invWidthSqrd, float &normD)
+{
+    G1V = Ndf::G1(NdV, width);
+    G1ExactV = (samplingMode == k_sampleVisible && Ndf::k_visibleSampling) ?
+                Ndf::G1Exact(NdV, width) : 0.f;
+    invWidthSqrd = 1.f / (width * width);
+    normD = Ndf::NormD(invWidthSqrd);
+}
+
+inline void
+beckmannViewTerms(int samplingMode, float NdV, float width,
+                  float &G1V, float &G1ExactV,
+                  float &invWidthSqrd, float &normD,
+                  int distribution = k_distBeckmann)
+{
+    if (distribution == k_distGgx)
+        beckmannViewTermsT<PxrGgxNdf>(samplingMode, NdV, width, G1V, G1ExactV,
+                                      invWidthSqrd, normD);
+    else if (distribution == k_distBlinnPhong)
+        beckmannViewTermsT<PxrBlinnPhongNdf>(samplingMode, NdV, width, G1V,
+                                             G1ExactV, invWidthSqrd, normD);
+    else
+        beckmannViewTermsT<PxrBeckmannNdf>(samplingMode, NdV, width, G1V,
+                                           G1ExactV, invWidthSqrd, normD);
+}
+
+// Scalar D, G1 and pdf of any distribution, for code outside the block
+// kernels. These switch on the distribution every call.
+inline float
+beckmannNdfD(int distribution, float cosThetaSqrd, float invWidthSqrd,
+             float normD)
+{
+    if (distribution == k_distGgx)
+        return PxrGgxNdf::D(cosThetaSqrd, invWidthSqrd, normD);
+    if (distribution == k_distBlinnPhong)
+        return PxrBlinnPhongNdf::D(cosThetaSqrd, invWidthSqrd, normD);
+    return PxrBeckmannNdf::D(cosThetaSqrd, invWidthSqrd, normD);
+}
+
+inline float
+beckmannNdfG1(int distribution, float cosV, float width)
+{
+    if (distribution == k_distGgx)
+        return PxrGgxNdf::G1(cosV, width);
+    if (distribution == k_distBlinnPhong)
+        return PxrBlinnPhongNdf::G1(cosV, width);
+    return PxrBeckmannNdf::G1(cosV, width);
+}
+
+inline float
+beckmannNdfPdf(int distribution, int samplingMode, float D, float cosM,
+               float cosV, float VdM, float width)
+{
+    if (distribution == k_distGgx)
+        return beckmannPdfT<PxrGgxNdf>(samplingMode, D, cosM, cosV, VdM, width);
+    if (distribution == k_distBlinnPhong)
+        return beckmannPdfT<PxrBlinnPhongNdf>(k_sampleNdf, D, cosM, cosV, VdM,
+                                              width);
+    return beckmannPdfT<PxrBeckmannNdf>(samplingMode, D, cosM, cosV, VdM,
+                                        width);
+}
+
+// Sample k of n of a rank-1 lattice, stratified in u0 and spread by the
+// golden ratio in u1, Cranley-Patterson rotated by (shift0, shift1). One
+// random shift per point gives it n well stratified samples.
+inline void
+beckmannLatticeSample(int k, int n, float shift0, float shift1,
+                      float &u0, float &u1)
+{
+    u0 = ((float) k + shift0) / (float) n;
+    u1 = shift1 + (float) k * .618033989f;
+    u1 -= (float) (int) u1;
+    u0 = beckmannMin(u0, .99999994f);
+    u1 = beckmannMin(u1, .99999994f);
+}
+
+// Cosine weighted direction in the local (TX, TY, N) frame, pdf z / pi.
+inline void
+beckmannSampleCosine(float u1, float u2, float &x, float &y, float &z)
+{
+    float r = sqrtf(u1);
+    float sinPhi, cosPhi;
+    beckmannSincos(u2 * 2.f * (float) M_PI, sinPhi, cosPhi);
+    x = r * cosPhi;
+    y = r * sinPhi;
+    z = sqrtf(beckmannMax(0.f, 1.f - u1));
+}
+
+// Share of the reflected directions inside the cone of beckmannConeAngle.
+static const float k_coneFraction = .5f;
+
+// Half angle of the cone around the mirror direction that holds
+// k_coneFraction of the NDF sampled directions, for the ray spread and
+// texture/geometry LOD of the rays a lobe scatters. At normal incidence a
+// half vector tilted by theta turns L by 2 theta, so that is twice the
+// k_coneFraction quantile of the half vector angle. Off normal incidence a
+// tilt out of the plane of incidence only turns L by 2 theta NdV, so the
+// directions spread over an ellipse. (1 + NdV) / 2 of the normal cone holds
+// half of a Gaussian spread over that ellipse to within 2% down to NdV .1,
+// where keeping its solid angle, sqrt(NdV), holds only a quarter. Clamped
+// to the hemisphere.
+template <class Ndf>
+inline float
+beckmannConeAngleT(float width, float NdV)
+{
+    float x, y, z;
+    Ndf::SampleNdf(width, k_coneFraction, 0.f, x, y, z);
+    float cone = atan2f(x, z) * (1.f + beckmannMax(NdV, k_minfacing));
+    return beckmannMin(cone, (float) (.5 * M_PI));
+}
+
+inline float
+beckmannConeAngle(int distribution, float width, float NdV)
+{
+    if (distribution == k_distGgx)
+        return beckmannConeAngleT<PxrGgxNdf>(width, NdV);
+    if (distribution == k_distBlinnPhong)
+        return beckmannConeAngleT<PxrBlinnPhongNdf>(width, NdV);
+    return beckmannConeAngleT<PxrBeckmannNdf>(width, NdV);
+}
+
+// Samples the half vector for every lane of b. Expects Nx/y/z to already
+// face Vn, NdV to hold the (positive) facing cosine and TX/TY the shading
+// basis around N, and the view terms to be filled in. Lanes with blend < 1
+// pick the mirror lobe with probability 1 - blend and reuse the rest of xi0
+// for the microfacet lobe. Lanes with NdV <= k_minfacing are masked off.
+// Without reverse RPdf is 0 on every lane, mirror lanes included, which
+// saves the light side pdf terms (the exact G1 for visible normals) when
+// nobody reads it.
+template <class Ndf, int requestedMode, bool reverse>
+inline void
+beckmannGenerateBlockT(PxrBeckmannSoABlock &b, int n)
+{
+    const int samplingMode = Ndf::k_visibleSampling ? requestedMode : k_sampleNdf;
+    for (int i = 0; i < n; ++i)
+    {
+        float pMirror = 1.f - b.blend[i];
+        int mirror = b.xi0[i] < pMirror;
+        float xi0 = (b.xi0[i] - pMirror) / b.blend[i];
+        float width = b.width[i];
+
+        float x, y, cosTheta;
+        if (samplingMode == k_sampleVisible)
+        {
+            float vx = b.Vx[i]*b.TXx[i] + b.Vy[i]*b.TXy[i] + b.Vz[i]*b.TXz[i];
+            float vy = b.Vx[i]*b.TYx[i] + b.Vy[i]*b.TYy[i] + b.Vz[i]*b.TYz[i];
+            Ndf::SampleVisible(width, vx, vy, b.NdV[i], xi0, b.xi1[i],
+                               x, y, cosTheta);
+        }
+        else
+            Ndf::SampleNdf(width, xi0, b.xi1[i], x, y, cosTheta);
+
+        float mx = x * b.TXx[i] + y * b.TYx[i] + cosTheta * b.Nx[i];
+        float my = x * b.TXy[i] + y * b.TYy[i] + cosTheta * b.Ny[i];
+        float mz = x * b.TXz[i] + y * b.TYz[i] + cosTheta * b.Nz[i];
+
+        // microfacets facing away from V can not reflect it, reject them
+        float VdM = b.Vx[i]*mx + b.Vy[i]*my + b.Vz[i]*mz;
+        float Lx = 2.f * VdM * mx - b.Vx[i];
+        float Ly = 2.f * VdM * my - b.Vy[i];
+        float Lz = 2.f * VdM * mz - b.Vz[i];
+
+        float D = Ndf::D(cosTheta * cosTheta, b.invWidthSqrd[i], b.normD[i]);
+        D = (cosTheta > 0.f) ? D : 0.f;
+
+        float IdN = b.NdV[i];
+        float OdN = b.Nx[i]*Lx + b.Ny[i]*Ly + b.Nz[i]*Lz;
+        float G1 = b.G1V[i];
+        float G2 = Ndf::G1(OdN, width);
+
+        float blend = b.blend[i];
+        float fpdf = (samplingMode == k_sampleVisible) ?
+                     D * b.G1ExactV[i] / (4.f * IdN) :
+                     D * cosTheta / (4.f * VdM);
+        float rpdf = reverse ?
+            beckmannPdfT<Ndf>(samplingMode, D, cosTheta, OdN, VdM, width) : 0.f;
+
+        float RdN = 2.f * IdN;
+        b.Lx[i] = mirror ? RdN * b.Nx[i] - b.Vx[i] : Lx;
+        b.Ly[i] = mirror ? RdN * b.Ny[i] - b.Vy[i] : Ly;
+        b.Lz[i] = mirror ? RdN * b.Nz[i] - b.Vz[i] : Lz;
+        b.radiance[i] = mirror ? pMirror : blend * G1 * G2 * D / (4.f * IdN);
+        b.FPdf[i] = mirror ? pMirror : blend * fpdf;
+        b.RPdf[i] = (mirror && reverse) ? pMirror :
+                    ((OdN > 0.f) ? blend * rpdf : 0.f);
+        b.mirror[i] = mirror;
+        b.valid[i] = (IdN > k_minfacing) & (mirror | (VdM > 0.f));
+    }
+}
+
+// Evaluates the lobe for the light directions in Lx/y/z. Like the generate
+// kernel it expects N to face V and the view terms to be filled in; lanes
+// failing k_minfacing or NdL > 0 are masked off. Only the microfacet share
+// of the lobe is returned, the discrete mirror lobe can not be hit by a
+// light sample. Without reverse RPdf is left at 0, as in the generate
+// kernel.
+template <class Ndf, int requestedMode, bool reverse>
+inline void
+beckmannEvaluateBlockT(PxrBeckmannSoABlock &b, int n)
+{
+    const int samplingMode = Ndf::k_visibleSampling ? requestedMode : k_sampleNdf;
+    for (int i = 0; i < n; ++i)
+    {
+        float Nx = b.Nx[i], Ny = b.Ny[i], Nz = b.Nz[i];
+        float IdN = b.NdV[i];
+        float OdN = Nx*b.Lx[i] + Ny*b.Ly[i] + Nz*b.Lz[i];
+
+        float mx = b.Lx[i] + b.Vx[i];
+        float my = b.Ly[i] + b.Vy[i];
+        float mz = b.Lz[i] + b.Vz[i];
+        float invLen = 1.f / sqrtf(mx*mx + my*my + mz*mz);
+        float cosTheta = fabsf(Nx*mx + Ny*my + Nz*mz) * invLen;
+        float VdM = (b.Vx[i]*mx + b.Vy[i]*my + b.Vz[i]*mz) * invLen;
+        float cosThetaSqrd = cosTheta * cosTheta;
+
+        float width = b.width[i];
+        float D = Ndf::D(cosThetaSqrd, b.invWidthSqrd[i], b.normD[i]);
+        D = (cosThetaSqrd > 0.f) ? D : 0.f;
+
+        float G1 = b.G1V[i];
+        float G2 = Ndf::G1(OdN, width);
+
+        float blend = b.blend[i];
+        float fpdf = (samplingMode == k_sampleVisible) ?
+                     D * b.G1ExactV[i] / (4.f * IdN) :
+                     D * cosTheta / (4.f * VdM);
+        float rpdf = reverse ?
+            beckmannPdfT<Ndf>(samplingMode, D, cosTheta, OdN, VdM, width) : 0.f;
+
+        b.radiance[i] = blend * G1 * G2 * D / (4.f * IdN);
+        b.FPdf[i] = blend * fpdf;
+        b.RPdf[i] = (OdN > 0.f) ? blend * rpdf : 0.f;
+        b.valid[i] = (IdN > k_minfacing) & (OdN > 0.f) & (blend > 0.f);
+    }
+}
+
+// The sampling mode, distribution and whether RPdf is wanted are uniform
+// over a block, dispatch on them once so the lane loops above stay free
+// of control flow.
+template <class Ndf>
+inline void
+beckmannGenerateBlockNdf(PxrBeckmannSoABlock &b, int n, int samplingMode,
+                         bool reverse)
+{
+    if (samplingMode == k_sampleVisible)
+    {
+        if (reverse)
+            beckmannGenerateBlockT<Ndf, k_sampleVisible, true>(b, n);
+        else
+            beckmannGenerateBlockT<Ndf, k_sampleVisible, false>(b, n);
+    }
+    else
+    {
+        if (reverse)
+            beckmannGenerateBlockT<Ndf, k_sampleNdf, true>(b, n);
+        else
+            beckmannGenerateBlockT<Ndf, k_sampleNdf, false>(b, n);
+    }
+}
+
+template <class Ndf>
+inline void
+beckmannEvaluateBlockNdf(PxrBeckmannSoABlock &b, int n, int samplingMode,
+                         bool reverse)
+{
+    if (samplingMode == k_sampleVisible)
+    {
+        if (reverse)
+            beckmannEvaluateBlockT<Ndf, k_sampleVisible, true>(b, n);
+        else
+            beckmannEvaluateBlockT<Ndf, k_sampleVisible, false>(b, n);
+    }
+    else
+    {
+        if (reverse)
+            beckmannEvaluateBlockT<Ndf, k_sampleNdf, true>(b, n);
+        else
+            beckmannEvaluateBlockT<Ndf, k_sampleNdf, false>(b, n);
+    }
+}
+
+inline void
+beckmannGenerateBlock(PxrBeckmannSoABlock &b, int n, int samplingMode,
+                      int distribution = k_distBeckmann, bool reverse = true)
+{
+    if (distribution == k_distGgx)
+        beckmannGenerateBlockNdf<PxrGgxNdf>(b, n, samplingMode, reverse);
+    else if (distribution == k_distBlinnPhong)
+        beckmannGenerateBlockNdf<PxrBlinnPhongNdf>(b, n, samplingMode, reverse);
+    else
+        beckmannGenerateBlockNdf<PxrBeckmannNdf>(b, n, samplingMode, reverse);
+}
+
+inline void
+beckmannEvaluateBlock(PxrBeckmannSoABlock &b, int n, int samplingMode,
+                      int distribution = k_distBeckmann, bool reverse = true)
+{
+    if (distribution == k_distGgx)
+        beckmannEvaluateBlockNdf<PxrGgxNdf>(b, n, samplingMode, reverse);
+    else if (distribution == k_distBlinnPhong)
+        beckmannEvaluateBlockNdf<PxrBlinnPhongNdf>(b, n, samplingMode, reverse);
+    else
+        beckmannEvaluateBlockNdf<PxrBeckmannNdf>(b, n, samplingMode, reverse);
+}
+
+// The reference below is written out from the definitions in plain libm,
+// the way the original scalar EvaluateSample was, and shares nothing with
+// the policies above, so that agreeing with it says something.
+inline float
+beckmannReferenceD(int distribution, float cosTheta, float width)
+{
+    if (cosTheta <= 0.f)
+        return 0.f;
+    float cosThetaSqrd = cosTheta * cosTheta;
+    float width2 = width * width;
+    if (distribution == k_distGgx)
+    {
+        float t = (width2 - 1.f) * cosThetaSqrd + 1.f;
+        return width2 / ((float) M_PI * t * t);
+    }
+    if (distribution == k_distBlinnPhong)
+    {
+        float e = 2.f / width2;
+        return (e + 2.f) / (2.f * (float) M_PI) * powf(cosTheta, e);
+    }
+    return (1.f / ((float) M_PI * width2 * cosThetaSqrd * cosThetaSqrd)) *
+           expf((cosThetaSqrd - 1.f) / (width2 * cosThetaSqrd));
+}
+
+// Smith G1. Beckmann's is the compiled backend's (exact for the table
+// backend, which is within 1.6e-4 of it) unless exact is set.
+inline float
+beckmannReferenceG1(int distribution, float cosV, float width, bool exact)
+{
+    if (cosV <= 0.f)
+        return 0.f;
+    float tanV = sqrtf(1.f - cosV*cosV) / cosV;
+    if (distribution == k_distGgx)
+    {
+        float width2 = width * width;
+        return 2.f * cosV / (cosV + sqrtf(width2 + (1.f - width2) * cosV*cosV));
+    }
+    if (distribution == k_distBlinnPhong)
+    {
+        // Lambda = c / ((e + 1) cosV) int_cosV^1 (1 - cosV^2 / r^2)^(e / 2) dr
+        // with c = Gamma((e + 3) / 2) / (sqrt(pi) Gamma((e + 2) / 2)), by
+        // Simpson's rule on steps that bunch up at cosV, where the integrand
+        // rises steeply near grazing
+        double e = 2. / ((double) width * width);
+        double c = exp(lgamma(.5 * (e + 3.)) - lgamma(.5 * (e + 2.))) / sqrt(M_PI);
+        const int numSteps = 256;
+        double sum = 0.;
+        for (int i = 0; i <= numSteps; ++i)
+        {
+            double x = (double) i / numSteps;
+            double r = cosV + (1. - cosV) * x * x;
+            double f = pow(1. - (double) cosV * cosV / (r * r), .5 * e) *
+                       2. * x * (1. - cosV);
+            sum += f * ((i == 0 || i == numSteps) ? 1. : ((i & 1) ? 4. : 2.));
+        }
+        double lambda = c / ((e + 1.) * cosV) * sum / (3. * numSteps);
+        return (float) (1. / (1. + lambda));
+    }
+    float a = 1.f / (width * tanV);
+#if PXRBECKMANN_G1_BACKEND == PXRBECKMANN_G1_RATIONAL
+    if (!exact)
+    {
+        if (a < 1.6f)
+            return (3.535f*a + 2.181f*a*a) / (1.f + 2.276f*a + 2.577f*a*a);
+        return 1.f;
+    }
+#endif
+    return 2.f / (1.f + erff(a) + expf(-a*a) / (a * sqrtf((float) M_PI)));
+}
+
+// Evaluates one light direction of one point with every term computed from
+// scratch, one sample at a time. This is the reference the block kernels
+// are checked against, not something to shade with. N must face V.
+inline void
+beckmannEvaluateReference(int distribution, int samplingMode,
+                          float const *N, float const *V, float const *L,
+                          float width, float blend,
+                          float &radiance, float &FPdf, float &RPdf)
+{
+    if (distribution == k_distBlinnPhong)
+        samplingMode = k_sampleNdf;
+    float IdN = N[0]*V[0] + N[1]*V[1] + N[2]*V[2];
+    float OdN = N[0]*L[0] + N[1]*L[1] + N[2]*L[2];
+    float m[3] = { L[0] + V[0], L[1] + V[1], L[2] + V[2] };
+    float len = sqrtf(m[0]*m[0] + m[1]*m[1] + m[2]*m[2]);
+    m[0] /= len; m[1] /= len; m[2] /= len;
+    float cosTheta = fabsf(N[0]*m[0] + N[1]*m[1] + N[2]*m[2]);
+    float VdM = V[0]*m[0] + V[1]*m[1] + V[2]*m[2];
+
+    float D = beckmannReferenceD(distribution, cosTheta, width);
+    float G1 = beckmannReferenceG1(distribution, IdN, width, false);
+    float G2 = beckmannReferenceG1(distribution, OdN, width, false);
+    radiance = blend * (G1 * G2 * D) / (4.f * IdN);
+
+    if (samplingMode == k_sampleVisible)
+    {
+        FPdf = blend * D * beckmannReferenceG1(distribution, IdN, width, true) /
+               (4.f * IdN);
+        RPdf = (OdN > 0.f) ? blend * D *
+               beckmannReferenceG1(distribution, OdN, width, true) / (4.f * OdN) :
+               0.f;
+    }
+    else
+    {
+        // V.m = L.m for the half vector
+        FPdf = blend * D * cosTheta / (4.f * VdM);
+        RPdf = (OdN > 0.f) ? FPdf : 0.f;
+    }
+}
+
+// Checks the evaluate kernel run the way EvaluateSamplesAtIndex runs it,
+// one point broadcast over the lanes and a different light in each, against
+// beckmannEvaluateReference sample by sample. Covers numPoints random
+// points of every distribution and sampling mode with up to two blocks of
+// lights each. Returns the largest difference relative to
+// max(1, |reference|), or -1 if the kernel masks a lane the reference
+// lights or the other way round.
+inline float
+beckmannCompareBatchedEvaluate(int numPoints = 256)
+{
+    float worst = 0.f;
+    unsigned int state = 7;
+    PxrBeckmannSoABlock b;
+    for (int p = 0; p < numPoints; ++p)
+    {
+        int distribution = p % k_numDistributions;
+        int samplingMode = (p / k_numDistributions) & 1;
+        float u[4];
+        for (int j = 0; j < 4; ++j)
+        {
+            state = state * 1664525u + 1013904223u;
+            u[j] = (float) (state >> 8) * (1.f / 16777216.f);
+        }
+        float NdV = .001f + .999f * u[0];
+        float V[3] = { sqrtf(1.f - NdV*NdV), 0.f, NdV };
+        float N[3] = { 0.f, 0.f, 1.f };
+        float width = .02f + u[1];
+        float blend = beckmannMin(1.f, .1f + 2.f * u[2]);
+        int nsamps = 1 + (int) (u[3] * 2 * k_soaBlockSize);
+
+        for (int k = 0; k < k_soaBlockSize; ++k)
+        {
+            b.Nx[k] = N[0]; b.Ny[k] = N[1]; b.Nz[k] = N[2];
+            b.Vx[k] = V[0]; b.Vy[k] = V[1]; b.Vz[k] = V[2];
+            b.NdV[k] = NdV;
+            b.width[k] = width;
+            b.blend[k] = blend;
+            beckmannViewTerms(samplingMode, NdV, width, b.G1V[k], b.G1ExactV[k],
+                              b.invWidthSqrd[k], b.normD[k], distribution);
+        }
+
+        for (int first = 0; first < nsamps; first += k_soaBlockSize)
+        {
+            int n = beckmannMin(nsamps - first, k_soaBlockSize);
+            for (int k = 0; k < n; ++k)
+            {
+                // uniform over the sphere, so some lights are below
+                state = state * 1664525u + 1013904223u;
+                float z = 2.f * (float) (state >> 8) * (1.f / 16777216.f) - 1.f;
+                state = state * 1664525u + 1013904223u;
+                float phi = 2.f * (float) M_PI * (float) (state >> 8) * (1.f / 16777216.f);
+                float r = sqrtf(beckmannMax(0.f, 1.f - z*z));
+                b.index[k] = first + k;
+                b.Lx[k] = r * cosf(phi);
+                b.Ly[k] = r * sinf(phi);
+                b.Lz[k] = z;
+            }
+            beckmannEvaluateBlock(b, n, samplingMode, distribution);
+
+            for (int k = 0; k < n; ++k)
+            {
+                float L[3] = { b.Lx[k], b.Ly[k], b.Lz[k] };
+                float radiance, FPdf, RPdf;
+                beckmannEvaluateReference(distribution, samplingMode, N, V, L,
+                                          width, blend, radiance, FPdf, RPdf);
+                if (b.valid[k] != (L[2] > 0.f))
+                    return -1.f;
+                if (!b.valid[k])
+                    continue;
+                float x[3] = { radiance, FPdf, RPdf };
+                float y[3] = { b.radiance[k], b.FPdf[k], b.RPdf[k] };
+                for (int j = 0; j < 3; ++j)
+                    worst = beckmannMax(worst, fabsf(x[j] - y[j]) /
+                                        beckmannMax(1.f, fabsf(x[j])));
+            }
+        }
+    }
+    return worst;
+}
+
+// Checks beckmannConeAngle against the NDF sampling kernel: a share
+// k_coneFraction of the generated directions should fall inside the cone
+// around the mirror direction. Covers every distribution over widths from
+// .05 to .8 at normal incidence, where the mapping is exact, and from .05
+// to .4 at NdV .7, .4 and .2, where it is a fit, with numBlocks blocks
+// each. Returns the largest difference of that share from
+// k_coneFraction. With the default 64 blocks per case sampling noise
+// reaches ~.03, and the fit is within ~.02, so anything above .05 points
+// at a wrong mapping. Wider lobes at grazing angles lose directions below
+// the horizon and aren't checked.
+inline float
+beckmannCheckConeAngle(int numBlocks = 64)
+{
+    static const float s_widths[] = { .05f, .1f, .2f, .4f, .8f };
+    static const float s_cosines[] = { 1.f, .7f, .4f, .2f };
+    static const int s_numWidths = sizeof(s_widths) / sizeof(s_widths[0]);
+    float worst = 0.f;
+    unsigned int state = 3;
+    PxrBeckmannSoABlock b;
+    for (int d = 0; d < k_numDistributions; ++d)
+    {
+        for (int c = 0; c < (int) (sizeof(s_cosines) / sizeof(s_cosines[0])); ++c)
+        {
+            float NdV = s_cosines[c];
+            float sinV = sqrtf(1.f - NdV * NdV);
+            for (int w = 0; w < (c ? s_numWidths - 1 : s_numWidths); ++w)
+            {
+                float width = s_widths[w];
+                float cosCone = cosf(beckmannConeAngle(d, width, NdV));
+                for (int i = 0; i < k_soaBlockSize; ++i)
+                {
+                    b.index[i] = i;
+                    b.Nx[i] = 0.f;  b.Ny[i] = 0.f;  b.Nz[i] = 1.f;
+                    b.Vx[i] = sinV; b.Vy[i] = 0.f;  b.Vz[i] = NdV;
+                    b.TXx[i] = 1.f; b.TXy[i] = 0.f; b.TXz[i] = 0.f;
+                    b.TYx[i] = 0.f; b.TYy[i] = 1.f; b.TYz[i] = 0.f;
+                    b.NdV[i] = NdV;
+                    b.width[i] = width;
+                    b.blend[i] = 1.f;
+                    beckmannViewTerms(k_sampleNdf, NdV, width, b.G1V[i],
+                                      b.G1ExactV[i], b.invWidthSqrd[i],
+                                      b.normD[i], d);
+                }
+
+                // mirror direction (-sinV, 0, NdV)
+                int inside = 0;
+                for (int k = 0; k < numBlocks; ++k)
+                {
+                    for (int i = 0; i < k_soaBlockSize; ++i)
+                    {
+                        state = state * 1664525u + 1013904223u;
+                        b.xi0[i] = (float) (state >> 8) * (1.f / 16777216.f);
+                        state = state * 1664525u + 1013904223u;
+                        b.xi1[i] = (float) (state >> 8) * (1.f / 16777216.f);
+                    }
+                    beckmannGenerateBlock(b, k_soaBlockSize, k_sampleNdf, d);
+                    for (int i = 0; i < k_soaBlockSize; ++i)
+                        inside += b.valid[i] &&
+                                  NdV * b.Lz[i] - sinV * b.Lx[i] > cosCone;
+                }
+                float share = (float) inside /
+                              (float) (numBlocks * k_soaBlockSize);
+                worst = beckmannMax(worst, fabsf(share - k_coneFraction));
+            }
+        }
+    }
+    return worst;
+}
+
+
+// Directional albedo of the microfacet lobe, E(width, NdV), the fraction of
+// energy reflected for color = 1. Built once per factory and looked up per
+// shading point with bilinear interpolation. Columns are spaced in
+// sqrt(width / MaxWidth()) since the albedo changes fastest for narrow
+// lobes; wider lobes clamp to the last column. Each entry is a 2048 point
+// Hammersley estimate using visible normal sampling, W / FPdf = G1 * G2 /
+// G1exact, which is smooth enough that the table is within 5e-3 of brute
+// force integration. Blinn-Phong has no visible normal sampler and uses
+// NDF sampling instead, W / FPdf = G1 * G2 * VdM / (NdV * cosM). One table
+// per distribution.
+// The entries either live in the object (Build) or somewhere else, eg. a
+// table file mapped by every process on a node (Attach, see
+// PxrBeckmannTables.h), in which case the object holds no copy of them.
+class PxrBeckmannAlbedoTable
+{
+public:
+    static const int k_widthRes = 32;
+    static const int k_cosRes = 32;
+    static const int k_numSamples = 2048;
+    static const int k_size = k_widthRes * k_cosRes;
+
+    PxrBeckmannAlbedoTable() : m_values(0) {}
+
+    static float MaxWidth() { return 2.f; }
+
+    void Build(int distribution = k_distBeckmann)
+    {
+        m_table.resize(k_size);
+        for (int j = 0; j < k_widthRes; ++j)
+            BuildRow(distribution, j, &m_table[j * k_cosRes]);
+        m_values = &m_table[0];
+    }
+
+    // Row j (one width) of the table, k_cosRes entries. Rows are
+    // independent so builders can spread them over threads.
+    static void BuildRow(int distribution, int j, float *row)
+    {
+        float u = (float) j / (k_widthRes - 1);
+        for (int k = 0; k < k_cosRes; ++k)
+            row[k] = Integrate(MaxWidth() * u * u, (float) k / (k_cosRes - 1),
+                               distribution);
+    }
+
+    // Looks up k_size entries laid out like Build's instead of our own,
+    // values must outlive the table.
+    void Attach(float const *values)
+    {
+        std::vector<float>().swap(m_table);
+        m_values = values;
+    }
+
+    float const *Values() const { return m_values; }
+
+    float Lookup(float width, float NdV) const
+    {
+        float fw = sqrtf(beckmannClamp(width / MaxWidth(), 0.f, 1.f)) *
+                   (k_widthRes - 1);
+        float fc = beckmannClamp(NdV, 0.f, 1.f) * (k_cosRes - 1);
+        int j = (int) fw;
+        int k = (int) fc;
+        j = (j < k_widthRes - 2) ? j : k_widthRes - 2;
+        k = (k < k_cosRes - 2) ? k : k_cosRes - 2;
+        float tw = fw - j;
+        float tc = fc - k;
+        float const *t = m_values + j * k_cosRes + k;
+        float e0 = t[0] + tc * (t[1] - t[0]);
+        float e1 = t[k_cosRes] + tc * (t[k_cosRes + 1] - t[k_cosRes]);
+        return e0 + tw * (e1 - e0);
+    }
+
+    // Albedo of a single (width, NdV) cell, also handy to check the table.
+    static float Integrate(float width, float NdV,
+                           int distribution = k_distBeckmann)
+    {
+        if (distribution == k_distGgx)
+            return IntegrateT<PxrGgxNdf>(width, NdV);
+        if (distribution == k_distBlinnPhong)
+            return IntegrateT<PxrBlinnPhongNdf>(width, NdV);
+        return IntegrateT<PxrBeckmannNdf>(width, NdV);
+    }
+
+private:
+    template <class Ndf>
+    static float IntegrateT(float width, float NdV)
+    {
+        if (width <= 0.f)
+            return 1.f; // mirror
+        NdV = beckmannMax(NdV, k_minfacing);
+        float vx = sqrtf(beckmannMax(0.f, 1.f - NdV*NdV));
+        float sum = 0.f;
+        for (int s = 0; s < k_numSamples; ++s)
+        {
+            // Hammersley point set
+            unsigned int bits = (unsigned int) s;
+            bits = (bits << 16u) | (bits >> 16u);
+            bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+            bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+            bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+            bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+            float u1 = (s + .5f) / k_numSamples;
+            float u2 = (float) bits * 2.3283064e-10f;
+
+            float mx, my, mz;
+            if (Ndf::k_visibleSampling)
+                Ndf::SampleVisible(width, vx, 0.f, NdV, u1, u2, mx, my, mz);
+            else
+                Ndf::SampleNdf(width, u1, u2, mx, my, mz);
+            float VdM = vx * mx + NdV * mz;
+            float OdN = 2.f * VdM * mz - NdV;
+            if (VdM <= 0.f || OdN <= 0.f)
+                continue;
+            float G = Ndf::G1(NdV, width) * Ndf::G1(OdN, width);
+            sum += Ndf::k_visibleSampling ? G / Ndf::G1Exact(NdV, width) :
+                                            G * VdM / (NdV * mz);
+        }
+        return sum / k_numSamples;
+    }
+
+    // m_values would point into the other table's entries
+    PxrBeckmannAlbedoTable(PxrBeckmannAlbedoTable const &);
+    PxrBeckmannAlbedoTable &operator=(PxrBeckmannAlbedoTable const &);
+
+    float const *m_values; // m_table unless attached
+    std::vector<float> m_table; // empty when attached
+};
+
+#endif
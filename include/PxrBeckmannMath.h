@@ -0,0 +1,197 @@
+#ifndef PxrBeckmannMath_h
+#define PxrBeckmannMath_h
+//----------------------------------------------------------------------------------------------------------------------
+/// @file PxrBeckmannMath.h
+/// @brief Bounded error exp, log, sincos and erf for the Beckmann kernels.
+/// libm's expf/logf/sinf/cosf/erff are scalar calls that stop the block
+/// kernels from vectorising and make up most of their cycles. These are
+/// branch free polynomial versions (Cephes coefficients) built from plain
+/// float and int operations, so the compiler can inline and vectorise them.
+/// Measured against double precision libm (exhaustively over every float
+/// in the ranges below for exp and log, 10^7 random arguments for sincos
+/// and erf) the max errors are:
+///   beckmannExp     x in [-87, 88]            1.02 ulp
+///   beckmannLog     x in [FLT_MIN, FLT_MAX]   0.83 ulp
+///   beckmannSincos  x in [0, 2 pi]            1.52 ulp (7.8e-8 abs near 0)
+///   beckmannErf     x in [-4, 4]              2e-7 abs (+-1 beyond)
+/// The ulps check of bench/PxrBeckmannBench holds them to these.
+/// The block loops only vectorise once gcc may assume no traps
+/// (-fno-trapping-math, set in the .pro). They are not built with
+/// -ffinite-math-only: exp and log return inf/nan outside their domains,
+/// and G1 divides by sinV = 0 at normal incidence, relying on the selects
+/// around those to see the inf. Define PXRBECKMANN_USE_LIBM to fall back
+/// to libm.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <cmath>
+#include <cstring>
+
+// Plain selects rather than fminf/fmaxf. Those have to honour nan
+// operands, so without -ffinite-math-only gcc emits library calls for them,
+// which costs more than the polynomials below and stops vectorisation.
+inline float beckmannMin(float a, float b) { return a < b ? a : b; }
+inline float beckmannMax(float a, float b) { return a > b ? a : b; }
+inline float
+beckmannClamp(float x, float lo, float hi)
+{
+    return beckmannMin(beckmannMax(x, lo), hi);
+}
+
+
+#ifndef PXRBECKMANN_USE_LIBM
+
+inline float
+beckmannAsFloat(int i)
+{
+    float f;
+    std::memcpy(&f, &i, sizeof(f));
+    return f;
+}
+
+inline int
+beckmannAsInt(float f)
+{
+    int i;
+    std::memcpy(&i, &f, sizeof(i));
+    return i;
+}
+
+// Nearest integer to x for |x| < 2^22. Adding 1.5 * 2^23 leaves the rounded
+// value in the low mantissa bits. floorf and lrintf are library calls
+// unless the compiler may ignore the inexact flag, and a float to int cast
+// of an unbounded value can't be speculated, which keeps the kernel loops
+// from if-converting.
+inline int
+beckmannRoundToInt(float x)
+{
+    return beckmannAsInt(x + 12582912.f) - 0x4B400000;
+}
+
+// e^x. Returns 0 below the normal range and +inf above it.
+inline float
+beckmannExp(float x)
+{
+    float xc = beckmannClamp(x, -87.33654f, 88.72283f);
+    int ni = beckmannRoundToInt(xc * 1.44269504f); // round(x / ln2)
+    float n = (float) ni;
+    float r = xc - n * .693359375f;            // Cody-Waite ln2 split
+    r = r - n * -2.12194440e-4f;
+
+    float p = 1.9875691500e-4f;
+    p = p * r + 1.3981999507e-3f;
+    p = p * r + 8.3334519073e-3f;
+    p = p * r + 4.1665795894e-2f;
+    p = p * r + 1.6666665459e-1f;
+    p = p * r + 5.0000001201e-1f;
+    p = p * r * r + r + 1.f;
+
+    // scale by 2^n in two halves so n = 128 does not overflow the exponent
+    int n1 = ni >> 1;
+    float y = p * beckmannAsFloat((n1 + 127) << 23) *
+                  beckmannAsFloat((ni - n1 + 127) << 23);
+    y = (x < -87.33654f) ? 0.f : y;
+    return (x > 88.72283f) ? HUGE_VALF : y;
+}
+
+// Natural log. Returns -inf for 0 and NaN for negative x; denormals are
+// treated as 0.
+inline float
+beckmannLog(float x)
+{
+    int ix = beckmannAsInt(x);
+    int e = ((ix >> 23) & 0xff) - 126;
+    float m = beckmannAsFloat((ix & 0x007fffff) | 0x3f000000); // [.5, 1)
+
+    int small = m < .70710678f;
+    float fe = (float) (e - small);
+    m = small ? m + m - 1.f : m - 1.f;
+
+    float z = m * m;
+    float y = 7.0376836292e-2f;
+    y = y * m - 1.1514610310e-1f;
+    y = y * m + 1.1676998740e-1f;
+    y = y * m - 1.2420140846e-1f;
+    y = y * m + 1.4249322787e-1f;
+    y = y * m - 1.6668057665e-1f;
+    y = y * m + 2.0000714765e-1f;
+    y = y * m - 2.4999993993e-1f;
+    y = y * m + 3.3333331174e-1f;
+    y = y * m * z;
+    y += fe * -2.12194440e-4f;
+    y -= .5f * z;
+    float r = m + y + fe * .693359375f;
+
+    r = (x < 1.17549435e-38f) ? -HUGE_VALF : r;
+    r = (x < 0.f) ? NAN : r;
+    return (x == HUGE_VALF) ? HUGE_VALF : r;
+}
+
+// sin(x) and cos(x) sharing one range reduction.
+inline void
+beckmannSincos(float x, float &s, float &c)
+{
+    int qi = beckmannRoundToInt(x * .63661977f); // round(x / (pi/2))
+    float q = (float) qi;
+    float r = x - q * 1.5703125f;           // three part pi/2 split
+    r = r - q * 4.83751296997070312e-4f;
+    r = r - q * 7.54978995489188216e-8f;
+    float z = r * r;
+
+    float sr = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z
+                - 1.6666654611e-1f) * z * r + r;
+    float cr = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z
+                + 4.166664568298827e-2f) * z * z - .5f * z + 1.f;
+
+    int quadrant = qi & 3;
+    float sv = (quadrant & 1) ? cr : sr;
+    float cv = (quadrant & 1) ? sr : cr;
+    s = (quadrant & 2) ? -sv : sv;
+    c = ((quadrant + 1) & 2) ? -cv : cv;
+}
+
+// erf(x) to 2e-7 absolute. Below 1 its Taylor series, which has no
+// cancellation; above, Abramowitz and Stegun 7.1.26, whose 1 - p e^-x^2
+// loses too many bits closer to 0.
+inline float
+beckmannErf(float x)
+{
+    float ax = beckmannMin(fabsf(x), 10.f);
+    float z = ax * ax;
+
+    float s = 1.4807192816e-8f;
+    s = s * z - 1.6365844691e-7f;
+    s = s * z + 1.6462114366e-6f;
+    s = s * z - 1.4925650358e-5f;
+    s = s * z + 1.2055332982e-4f;
+    s = s * z - 8.5483270235e-4f;
+    s = s * z + 5.2239776254e-3f;
+    s = s * z - 2.6866170645e-2f;
+    s = s * z + 1.1283791671e-1f;
+    s = s * z - 3.7612638903e-1f;
+    s = s * z + 1.1283791671e+0f;
+    s *= ax;
+
+    float t = 1.f / (1.f + .3275911f * ax);
+    float p = 1.061405429f;
+    p = p * t - 1.453152027f;
+    p = p * t + 1.421413741f;
+    p = p * t - .284496736f;
+    p = p * t + .254829592f;
+    float y = (ax < 1.f) ? s : 1.f - p * t * beckmannExp(-z);
+    return (x < 0.f) ? -y : y;
+}
+
+#else
+
+inline float beckmannExp(float x) { return expf(x); }
+inline float beckmannErf(float x) { return erff(x); }
+inline float beckmannLog(float x) { return logf(x); }
+inline void beckmannSincos(float x, float &s, float &c)
+{
+    s = sinf(x);
+    c = cosf(x);
+}
+
+#endif
+
+#endif
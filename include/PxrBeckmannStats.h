@@ -0,0 +1,300 @@
+#ifndef PxrBeckmannStats_h
+#define PxrBeckmannStats_h
+//----------------------------------------------------------------------------------------------------------------------
+/// @file PxrBeckmannStats.h
+/// @brief Optional counters of where the BxDF spends and wastes its samples,
+/// and latency histograms of its entry points.
+/// Each shading thread bumps its own block of counters, registered once on
+/// a lock-free list, so nothing is shared while rendering. The factory sums
+/// the blocks and reports them at render end. The counters compile to
+/// empty inline functions unless PXRBECKMANN_STATS is defined, the timers
+/// unless PXRBECKMANN_TIMING is.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <cstring>
+
+enum PxrBeckmannStat
+{
+    k_statGenerateCalls,
+    k_statGeneratePoints,
+    k_statEvaluateCalls,
+    k_statEvaluatePoints,
+    k_statEvaluateAtIndexCalls,
+    k_statEvaluateAtIndexSamples,
+    k_statMinFacing,          // points failing NdV > k_minfacing
+    k_statRouletteKilled,     // paths terminated by russian roulette
+    k_statMirrorSamples,      // samples taken from the discrete mirror lobe
+    k_statBackfacingNormal,   // sampled microfacets facing away from V
+    k_statLightBelow,         // light samples rejected for NdL <= 0
+    k_statG1Zero,             // points whose view side G1 is zero
+    k_statG2Zero,             // samples whose light side G1 is zero
+    k_statNonFinite,          // weights or pdfs that came out nan/inf
+    k_statSimplifiedPoints,   // points shaded with the simplified lobe
+    k_numStats
+};
+
+inline char const *
+beckmannStatName(int stat)
+{
+    static char const *s_names[k_numStats] =
+    {
+        "generateCalls",
+        "generatePoints",
+        "evaluateCalls",
+        "evaluatePoints",
+        "evaluateAtIndexCalls",
+        "evaluateAtIndexSamples",
+        "minFacing",
+        "rouletteKilled",
+        "mirrorSamples",
+        "backfacingNormal",
+        "lightBelow",
+        "G1Zero",
+        "G2Zero",
+        "nonFinite",
+        "simplifiedPoints"
+    };
+    return s_names[stat];
+}
+
+// True for nan and +/-inf. Tests the exponent bits directly so the check
+// survives a build with -ffinite-math-only, which folds std::isfinite.
+inline bool
+beckmannIsNonFinite(float x)
+{
+    unsigned int i;
+    std::memcpy(&i, &x, sizeof(i));
+    return (i & 0x7f800000u) == 0x7f800000u;
+}
+
+#if defined(PXRBECKMANN_STATS) || defined(PXRBECKMANN_TIMING)
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+
+// A block of N counters owned by one thread. Only the owning thread writes
+// them, so a relaxed load and store is enough; the atomics just make the
+// render end read safe. Tag keeps the counters and timers on separate lists.
+// Blocks start on their own cache line so one thread's writes never
+// invalidate a line another thread is counting in.
+template <class Tag, int N>
+struct alignas(64) PxrBeckmannThreadCounters
+{
+    std::atomic<unsigned long long> count[N];
+    PxrBeckmannThreadCounters *next;
+
+    PxrBeckmannThreadCounters() : next(0)
+    {
+        for (int i = 0; i < N; ++i)
+            count[i].store(0, std::memory_order_relaxed);
+    }
+
+    void Add(int i, unsigned long long n)
+    {
+        count[i].store(count[i].load(std::memory_order_relaxed) + n,
+                       std::memory_order_relaxed);
+    }
+
+    static std::atomic<PxrBeckmannThreadCounters *> &Head()
+    {
+        static std::atomic<PxrBeckmannThreadCounters *> s_head(0);
+        return s_head;
+    }
+
+    // The calling thread's block, pushed onto the list on first use. Blocks
+    // live until the plugin is unloaded so late readers never see freed
+    // memory.
+    static PxrBeckmannThreadCounters &Local()
+    {
+        static thread_local PxrBeckmannThreadCounters *t_local = 0;
+        if (!t_local)
+        {
+            // new need not honour alignas before C++17, so place the block
+            // in over-allocated storage
+            uintptr_t storage = (uintptr_t) ::operator new(
+                sizeof(PxrBeckmannThreadCounters) + alignof(PxrBeckmannThreadCounters));
+            storage = (storage + alignof(PxrBeckmannThreadCounters) - 1) &
+                      ~(uintptr_t) (alignof(PxrBeckmannThreadCounters) - 1);
+            t_local = new ((void *) storage) PxrBeckmannThreadCounters;
+            PxrBeckmannThreadCounters *head = Head().load(std::memory_order_relaxed);
+            do
+                t_local->next = head;
+            while (!Head().compare_exchange_weak(head, t_local,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed));
+        }
+        return *t_local;
+    }
+
+    // Sums every thread's block into totals.
+    static void Merge(unsigned long long totals[N])
+    {
+        std::memset(totals, 0, sizeof(unsigned long long) * N);
+        for (PxrBeckmannThreadCounters *s = Head().load(std::memory_order_acquire);
+             s; s = s->next)
+        {
+            for (int i = 0; i < N; ++i)
+                totals[i] += s->count[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    // Only safe while no thread is shading, eg. at render begin/end.
+    static void Reset()
+    {
+        for (PxrBeckmannThreadCounters *s = Head().load(std::memory_order_acquire);
+             s; s = s->next)
+        {
+            for (int i = 0; i < N; ++i)
+                s->count[i].store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+#endif
+
+#ifdef PXRBECKMANN_STATS
+
+struct PxrBeckmannStatsTag {};
+typedef PxrBeckmannThreadCounters<PxrBeckmannStatsTag, k_numStats> PxrBeckmannStats;
+
+// Counts on the stack for the duration of one BxDF call and adds them to
+// the thread's block once, on destruction.
+class PxrBeckmannStatTally
+{
+public:
+    PxrBeckmannStatTally() { std::memset(m_count, 0, sizeof(m_count)); }
+    ~PxrBeckmannStatTally()
+    {
+        PxrBeckmannStats &stats = PxrBeckmannStats::Local();
+        for (int i = 0; i < k_numStats; ++i)
+        {
+            if (m_count[i])
+                stats.Add(i, m_count[i]);
+        }
+    }
+    void Add(int stat, unsigned long long n = 1) { m_count[stat] += n; }
+private:
+    unsigned long long m_count[k_numStats];
+};
+
+#else
+
+class PxrBeckmannStatTally
+{
+public:
+    void Add(int, unsigned long long = 1) {}
+};
+
+#endif
+
+// Latency histograms. Every timed call lands in a bucket keyed by its entry
+// point, log2 of its point (or sample) count and log2 of its duration in ns.
+enum PxrBeckmannTimer
+{
+    k_timeBeginScatter,
+    k_timeGenerate,
+    k_timeEvaluate,
+    k_timeEvaluateAtIndex,
+    k_numTimers
+};
+
+static const int k_timeSizeBuckets = 12;  // 1, 2-3, 4-7 ... 2048+ points
+static const int k_timeNsBuckets = 32;    // [2^b, 2^(b+1)) ns
+
+inline char const *
+beckmannTimerName(int timer)
+{
+    static char const *s_names[k_numTimers] =
+    {
+        "BeginScatter",
+        "GenerateSample",
+        "EvaluateSample",
+        "EvaluateSamplesAtIndex"
+    };
+    return s_names[timer];
+}
+
+// floor(log2(x)) clamped to [0, buckets)
+inline int
+beckmannLog2Bucket(unsigned long long x, int buckets)
+{
+    int b = 0;
+    while (x > 1 && b < buckets - 1)
+    {
+        x >>= 1;
+        ++b;
+    }
+    return b;
+}
+
+inline int
+beckmannTimeBucket(int timer, int sizeBucket, int nsBucket)
+{
+    return (timer * k_timeSizeBuckets + sizeBucket) * k_timeNsBuckets + nsBucket;
+}
+
+#ifdef PXRBECKMANN_TIMING
+
+#include <chrono>
+
+struct PxrBeckmannTimingTag {};
+typedef PxrBeckmannThreadCounters<PxrBeckmannTimingTag,
+            k_numTimers * k_timeSizeBuckets * k_timeNsBuckets> PxrBeckmannTiming;
+
+// Times its own lifetime and adds it to the thread's histogram. steady_clock
+// is clock_gettime(CLOCK_MONOTONIC) through the vdso on linux, ~20ns a call,
+// and unlike the TSC needs no calibration.
+class PxrBeckmannScopedTimer
+{
+public:
+    PxrBeckmannScopedTimer(int timer, int size) :
+        m_timer(timer),
+        m_size(size),
+        m_start(std::chrono::steady_clock::now())
+    {
+    }
+    ~PxrBeckmannScopedTimer()
+    {
+        long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - m_start).count();
+        int sizeBucket = beckmannLog2Bucket(m_size > 0 ? m_size : 1,
+                                            k_timeSizeBuckets);
+        int nsBucket = beckmannLog2Bucket(ns > 0 ? ns : 1, k_timeNsBuckets);
+        PxrBeckmannTiming::Local().Add(
+            beckmannTimeBucket(m_timer, sizeBucket, nsBucket), 1);
+    }
+private:
+    int m_timer;
+    int m_size;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Upper bound in ns of the bucket holding the given fraction of a
+// histogram's calls.
+inline unsigned long long
+beckmannHistogramPercentile(unsigned long long const *histogram,
+                            unsigned long long total, double fraction)
+{
+    unsigned long long target = (unsigned long long) (fraction * total);
+    unsigned long long sum = 0;
+    for (int b = 0; b < k_timeNsBuckets; ++b)
+    {
+        sum += histogram[b];
+        if (sum > target)
+            return 2ull << b;
+    }
+    return 2ull << (k_timeNsBuckets - 1);
+}
+
+#else
+
+class PxrBeckmannScopedTimer
+{
+public:
+    PxrBeckmannScopedTimer(int, int) {}
+};
+
+#endif
+
+#endif
@@ -0,0 +1,432 @@
+#ifndef PxrBeckmannTables_h
+#define PxrBeckmannTables_h
+//----------------------------------------------------------------------------------------------------------------------
+/// @file PxrBeckmannTables.h
+/// @brief On disk cache of the precomputed tables (the albedo table of every
+/// distribution) so that the many prman processes on a node neither rebuild
+/// nor duplicate them. The file is a versioned header followed by the
+/// tables as plain floats with an FNV-1a checksum. Processes map it read
+/// only and shared, so they all use the same physical pages. A missing,
+/// stale or corrupt file is rebuilt on every core by one process while the
+/// others wait on a lock file, and replaced atomically through a rename,
+/// so readers never see a partial file. The cache is per user: the default
+/// directory is private to the user, files are created 0600 and only
+/// files owned by the user that no one else can write are mapped.
+/// Renderer free like PxrBeckmannKernels.h.
+//----------------------------------------------------------------------------------------------------------------------
+
+#include "PxrBeckmannKernels.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+    #include <fstream>
+    #include <io.h>
+#else
+    #include <fcntl.h>
+    #include <sys/file.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Bump on any change to the layout or to how the tables are computed.
+static const uint32_t k_tablesVersion = 4;
+static const char k_tablesMagic[8] = { 'P', 'X', 'R', 'B', 'K', 'T', 'B', 'L' };
+
+// The header records what the tables were built with, so a file from a
+// build with other table sizes, sample counts or math reads as stale.
+struct PxrBeckmannTablesHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;      // sizeof(PxrBeckmannTablesHeader)
+    uint32_t numTables;       // k_numDistributions
+    uint32_t widthRes;
+    uint32_t cosRes;
+    uint32_t numSamples;
+    uint32_t payloadBytes;    // tables following the header
+    uint32_t g1Backend;       // PXRBECKMANN_G1_BACKEND
+    uint32_t useLibm;         // 1 if built with PXRBECKMANN_USE_LIBM
+    uint32_t pad;
+    uint64_t checksum;        // FNV-1a of the payload
+};
+
+inline uint64_t
+beckmannTablesChecksum(void const *data, size_t size)
+{
+    unsigned char const *p = (unsigned char const *) data;
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+inline PxrBeckmannTablesHeader
+beckmannTablesHeader()
+{
+    PxrBeckmannTablesHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, k_tablesMagic, sizeof(h.magic));
+    h.version = k_tablesVersion;
+    h.headerSize = sizeof(h);
+    h.numTables = k_numDistributions;
+    h.widthRes = PxrBeckmannAlbedoTable::k_widthRes;
+    h.cosRes = PxrBeckmannAlbedoTable::k_cosRes;
+    h.numSamples = PxrBeckmannAlbedoTable::k_numSamples;
+    h.payloadBytes = k_numDistributions * PxrBeckmannAlbedoTable::k_size *
+                     sizeof(float);
+    h.g1Backend = PXRBECKMANN_G1_BACKEND;
+#ifdef PXRBECKMANN_USE_LIBM
+    h.useLibm = 1;
+#endif
+    return h;
+}
+
+// Builds the albedo tables of every distribution, one after the other in
+// values, spreading the rows over numThreads threads (0 for one per core).
+inline void
+beckmannBuildTables(std::vector<float> &values, int numThreads = 0)
+{
+    const int numRows = k_numDistributions * PxrBeckmannAlbedoTable::k_widthRes;
+    values.resize(k_numDistributions * PxrBeckmannAlbedoTable::k_size);
+    if (numThreads <= 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    numThreads = std::min(numThreads, numRows);
+
+    std::atomic<int> next(0);
+    float *out = &values[0];
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        threads.push_back(std::thread([&]()
+        {
+            for (int r = next++; r < numRows; r = next++)
+            {
+                int d = r / PxrBeckmannAlbedoTable::k_widthRes;
+                int j = r % PxrBeckmannAlbedoTable::k_widthRes;
+                PxrBeckmannAlbedoTable::BuildRow(d, j,
+                    out + r * PxrBeckmannAlbedoTable::k_cosRes);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+}
+
+#ifndef _WIN32
+// True if fd is a regular file owned by us that no one else can write, the
+// only files we map or lock. Anything else in the cache directory may have
+// been planted to feed us bad tables.
+inline bool
+beckmannTablesFileTrusted(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+           st.st_uid == geteuid() && !(st.st_mode & (S_IWGRP | S_IWOTH));
+}
+
+// Writes all of size bytes, through short writes and interrupts.
+inline bool
+beckmannWriteAll(int fd, void const *data, size_t size)
+{
+    char const *p = (char const *) data;
+    while (size)
+    {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= (size_t) n;
+    }
+    return true;
+}
+#endif
+
+// Writes values as a table file, through a new temporary file in the same
+// directory that is renamed over path, so concurrent readers see either
+// the old file or the whole new one. The temporary file is created
+// exclusively, 0600 and with an unpredictable name, so it can't be a
+// link planted by someone else.
+inline bool
+beckmannWriteTables(char const *path, std::vector<float> const &values)
+{
+    PxrBeckmannTablesHeader h = beckmannTablesHeader();
+    if (values.size() * sizeof(float) != h.payloadBytes)
+        return false;
+    h.checksum = beckmannTablesChecksum(&values[0], h.payloadBytes);
+
+    std::string name = std::string(path) + ".XXXXXX";
+    std::vector<char> tmp(name.begin(), name.end());
+    tmp.push_back(0);
+#ifdef _WIN32
+    if (_mktemp_s(&tmp[0], tmp.size()) != 0)
+        return false;
+    // "x" fails rather than open a file that is already there
+    FILE *f = fopen(&tmp[0], "wbx");
+    if (!f)
+        return false;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(&values[0], h.payloadBytes, 1, f) == 1;
+    ok = (fclose(f) == 0) && ok;
+    // rename does not replace an existing file on Windows
+    if (ok)
+        remove(path);
+#else
+    int fd = mkstemp(&tmp[0]); // O_CREAT | O_EXCL, 0600
+    if (fd < 0)
+        return false;
+    bool ok = beckmannWriteAll(fd, &h, sizeof(h)) &&
+              beckmannWriteAll(fd, &values[0], h.payloadBytes);
+    ok = (close(fd) == 0) && ok;
+#endif
+    if (!ok || rename(&tmp[0], path) != 0)
+    {
+        remove(&tmp[0]);
+        return false;
+    }
+    return true;
+}
+
+// The tables of one process: mapped from the cache file when it is good,
+// else rebuilt, written back for the other processes and mapped, and as a
+// last resort (eg. a read only cache directory) kept privately.
+class PxrBeckmannTables
+{
+public:
+    enum Source
+    {
+        k_none,
+        k_mapped,       // mapped an existing file
+        k_rebuilt,      // rebuilt, wrote and mapped the file
+        k_private       // rebuilt, could not use the file
+    };
+
+    PxrBeckmannTables() : m_data(0), m_size(0), m_values(0), m_source(k_none) {}
+    ~PxrBeckmannTables() { Close(); }
+
+    // Maps path, rebuilding it first if it is no good. Processes that find
+    // it missing or stale queue on path.lock: the first one rebuilds, the
+    // others then find the new file and map it.
+    Source Load(char const *path)
+    {
+        Close();
+        if (path && *path)
+        {
+            if (Open(path))
+                return m_source = k_mapped;
+
+            int lock = LockFile(path);
+            if (Open(path))
+            {
+                UnlockFile(lock);
+                return m_source = k_mapped;
+            }
+            std::vector<float> values;
+            beckmannBuildTables(values);
+            bool rebuilt = beckmannWriteTables(path, values) && Open(path);
+            UnlockFile(lock);
+            if (rebuilt)
+                return m_source = k_rebuilt;
+            return Keep(values);
+        }
+        std::vector<float> values;
+        beckmannBuildTables(values);
+        return Keep(values);
+    }
+
+    // Maps path if it is a complete table file of this version with a good
+    // checksum that we own and no one else can write.
+    bool Open(char const *path)
+    {
+        Close();
+        PxrBeckmannTablesHeader expected = beckmannTablesHeader();
+        size_t size = sizeof(expected) + expected.payloadBytes;
+#ifdef _WIN32
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return false;
+        m_buffer.assign(std::istreambuf_iterator<char>(in),
+                        std::istreambuf_iterator<char>());
+        m_data = m_buffer.empty() ? 0 : &m_buffer[0];
+        m_size = m_buffer.size();
+        if (m_size != size)
+        {
+            Close();
+            return false;
+        }
+#else
+        // O_NOFOLLOW and checking the file we opened, not the path, so it
+        // can't be swapped for a link between the check and the map
+        int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (!beckmannTablesFileTrusted(fd) || fstat(fd, &st) != 0 ||
+            (size_t) st.st_size != size)
+        {
+            close(fd);
+            return false;
+        }
+        // shared, so every process maps the same page cache pages
+        void *p = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            return false;
+        m_data = (char const *) p;
+        m_size = size;
+#endif
+        PxrBeckmannTablesHeader const *h = (PxrBeckmannTablesHeader const *) m_data;
+        if (std::memcmp(h->magic, expected.magic, sizeof(h->magic)) ||
+            h->version != expected.version ||
+            h->headerSize != expected.headerSize ||
+            h->numTables != expected.numTables ||
+            h->widthRes != expected.widthRes ||
+            h->cosRes != expected.cosRes ||
+            h->numSamples != expected.numSamples ||
+            h->payloadBytes != expected.payloadBytes ||
+            h->g1Backend != expected.g1Backend ||
+            h->useLibm != expected.useLibm ||
+            h->checksum != beckmannTablesChecksum(h + 1, h->payloadBytes))
+        {
+            Close();
+            return false;
+        }
+        m_values = (float const *) (h + 1);
+        m_source = k_mapped;
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        m_buffer.clear();
+#else
+        if (m_data)
+            munmap((void *) m_data, m_size);
+#endif
+        m_data = 0;
+        m_size = 0;
+        m_values = 0;
+        m_private.clear();
+        m_source = k_none;
+    }
+
+    // k_size entries of the albedo table of distribution, for
+    // PxrBeckmannAlbedoTable::Attach. Valid until Close.
+    float const *AlbedoTable(int distribution) const
+    {
+        return m_values ? m_values + distribution * PxrBeckmannAlbedoTable::k_size
+                        : 0;
+    }
+
+    Source GetSource() const { return m_source; }
+
+private:
+    PxrBeckmannTables(PxrBeckmannTables const &);
+    PxrBeckmannTables &operator=(PxrBeckmannTables const &);
+
+    Source Keep(std::vector<float> &values)
+    {
+        m_private.swap(values);
+        m_values = &m_private[0];
+        return m_source = k_private;
+    }
+
+    // Waits for the exclusive lock on path.lock and returns its descriptor,
+    // or -1 if it can't be had, in which case we go on without it: the
+    // rename still keeps readers safe, we may just build twice.
+    static int LockFile(char const *path)
+    {
+#ifdef _WIN32
+        (void) path;
+        return -1;
+#else
+        std::string name = std::string(path) + ".lock";
+        int fd = open(name.c_str(), O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC,
+                      0600);
+        if (fd < 0)
+            return -1;
+        if (!beckmannTablesFileTrusted(fd))
+        {
+            close(fd);
+            return -1;
+        }
+        int r;
+        while ((r = flock(fd, LOCK_EX)) != 0 && errno == EINTR)
+            ;
+        if (r != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+#endif
+    }
+
+    static void UnlockFile(int fd)
+    {
+#ifndef _WIN32
+        if (fd >= 0)
+            close(fd); // drops the lock
+#endif
+    }
+
+    char const *m_data;
+    size_t m_size;
+    float const *m_values;
+    std::vector<float> m_private;
+    Source m_source;
+#ifdef _WIN32
+    std::vector<char> m_buffer;
+#endif
+};
+
+// Default cache file, per user and per table version so old and new
+// plugins can share a node: PxrBeckmannTables.<version>.bin in
+// $TMPDIR (or /tmp) /PxrBeckmann-<uid>, a directory only the user can
+// enter. Empty if that directory can't be made or is not ours and private,
+// eg. someone else made it first.
+inline std::string
+beckmannDefaultTablesPath()
+{
+    char const *tmp = getenv("TMPDIR");
+    char name[64];
+#ifdef _WIN32
+    // %TEMP% is already per user
+    if (!tmp || !*tmp)
+        tmp = getenv("TEMP");
+    if (!tmp || !*tmp)
+        tmp = ".";
+    std::string dir(tmp);
+#else
+    if (!tmp || !*tmp)
+        tmp = "/tmp";
+    snprintf(name, sizeof(name), "/PxrBeckmann-%u", (unsigned int) geteuid());
+    std::string dir = std::string(tmp) + name;
+    if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST)
+        return std::string();
+    struct stat st;
+    if (lstat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) ||
+        st.st_uid != geteuid() || (st.st_mode & (S_IRWXG | S_IRWXO)))
+        return std::string();
+#endif
+    snprintf(name, sizeof(name), "/PxrBeckmannTables.%u.bin",
+             (unsigned int) k_tablesVersion);
+    return dir + name;
+}
+
+#endif
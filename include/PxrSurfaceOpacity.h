@@ -39,6 +39,7 @@
 
 #include "RixBxdf.h"
 #include "RixShadingUtils.h"
+#include <algorithm>
 #include <cassert>
 
 // PxrOpacity: a simple class to deliver opacity & presence to the renderer.
@@ -50,6 +51,9 @@
 //     * GetPresence is invoked to when renderer wishes to skip
 //       a more expensive shading computation.
 //     * GetOpacity is invoked for shadows and must include presence.
+//     * presence and transparency are either NULL (trivial), a single
+//       uniform value or one value per point.
+//  The varying loops work on plain float arrays so they vectorize.
 //  
 class PxrSurfaceOpacity : public RixOpacity 
 {
@@ -57,60 +61,96 @@ public:
     PxrSurfaceOpacity(RixShadingContext const *sc, RixBxdfFactory *bx,
                    RtFloat const *presence, 
                    RtColorRGB const *transparency,
-                   bool isUniform = false) :
+                   bool presenceUniform = false,
+                   bool transparencyUniform = false) :
                        RixOpacity(sc, bx),
                        m_presence(presence),
                        m_transparency(transparency),
-                       m_isUniform(isUniform)
+                       m_presenceUniform(presenceUniform),
+                       m_transparencyUniform(transparencyUniform)
     {
     }
 
     virtual bool 
     GetPresence(RtFloat *result)
     {
-        bool ret = false;
+        if(!m_presence)
+            return false;
+
+        RtInt nPts = shadingCtx->numPts;
+        if (m_presenceUniform)
+        {
+            std::fill_n(result, nPts, *m_presence);
+            return *m_presence != 1.0f; //signals nontrivally present
+        }
+
+        int notPresent = 0;
+        for (int i = 0; i < nPts; ++i)
+        {
+            result[i] = m_presence[i];
+            notPresent |= (m_presence[i] != 1.0f);
+        }
+        return notPresent != 0; //signals nontrivally present
+    }
+
+    virtual bool 
+    GetOpacity(RtColorRGB *result)
+    {
+        if(!m_transparency && !m_presence)
+            return false;
+
+        RtInt nPts = shadingCtx->numPts;
+        assert(sizeof(RtColorRGB) == 3 * sizeof(RtFloat));
+        RtFloat *out = &result[0].r;
+
+        // opacity = clamp(1 - transparency, 0, 1)
+        if(!m_transparency)
+            std::fill_n(result, nPts, RixConstants::k_OneRGB);
+        else if(m_transparencyUniform)
+        {
+            RtColorRGB opacity = RixConstants::k_OneRGB - *m_transparency;
+            opacity.ClampAlbedo();
+            std::fill_n(result, nPts, opacity);
+        }
+        else
+        {
+            RtFloat const *trans = &m_transparency[0].r;
+            for (int i = 0; i < 3 * nPts; ++i)
+            {
+                RtFloat o = 1.0f - trans[i];
+                o = o < 0.0f ? 0.0f : o;
+                out[i] = o > 1.0f ? 1.0f : o;
+            }
+        }
+
+        // scaled by presence, since shadows must include it
         if(m_presence)
         {
-            RtInt nPts = shadingCtx->numPts;
-            if (m_isUniform)
+            if(m_presenceUniform)
             {
-                std::fill_n(result, nPts, *m_presence);
-                ret = true; //signals nontrivally present
+                RtFloat presence = *m_presence;
+                for (int i = 0; i < 3 * nPts; ++i)
+                    out[i] *= presence;
             }
-            else 
+            else
             {
                 for (int i = 0; i < nPts; ++i)
                 {
-                    result[i] = m_presence[i];
-                    if(!ret && result[i] != 1.0f)
-                        ret = true; //signals nontrivally present
+                    RtFloat presence = m_presence[i];
+                    out[3*i+0] *= presence;
+                    out[3*i+1] *= presence;
+                    out[3*i+2] *= presence;
                 }
             }
         }
-        return ret;
+        return true;
     }
 
-    virtual bool 
-    GetOpacity(RtColorRGB *result)
-    {
-       RtInt nPts = shadingCtx->numPts;
-       bool ret = false;
-       if(m_transparency)
-       {
-           for (int i = 0; i < nPts; ++i)
-           {
-               result[i] = RixConstants::k_OneRGB - m_transparency[i];
-               result[i].ClampAlbedo();
-           }
-           ret = true;
-       }
-       return ret;
-   }
-
 private:
    RtFloat const *m_presence;
    RtColorRGB const *m_transparency;
-   bool m_isUniform;
+   bool m_presenceUniform;
+   bool m_transparencyUniform;
 };
 
 #endif
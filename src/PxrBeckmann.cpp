@@ -39,38 +39,111 @@
     #include "RixRNG.h"
 #endif
 #include "RixShadingUtils.h"
+#include "PxrBeckmannBsdf.h"
+#include "PxrBeckmannCapture.h"
+#include "PxrBeckmannDispatch.h"
+#include "PxrBeckmannKernels.h"
+#include "PxrBeckmannStats.h"
+#include "PxrBeckmannTables.h"
+#include "PxrSurfaceOpacity.h"
+#include <algorithm>
 #include <cstring> // memset
-
-static const RtFloat k_minfacing = .0001f; // NdV < k_minfacing is invalid
+#include <cstdint> // uintptr_t
+#include <new>
+#include <cstdio>
+#include <cstdlib> // getenv
 
 static const unsigned char k_reflBlinnLobeId = 0;
+static const unsigned char k_reflMirrorLobeId = 1;
+
+// Bits of the lobes a point wants sampled, see PxrBeckmann::wantedLobes
+static const int k_wantBlinn = 1;
+static const int k_wantMirror = 2;
 
-static RixBXLobeSampled s_reflBlinnLobe;
+// The lobes we were given at RenderBegin. Owned by the factory so several
+// renders or factories in one process don't share them, written only in
+// Synchronize and read by every shading thread after that. Aligned so the
+// struct has its cache line(s) to itself.
+struct alignas(64) PxrBeckmannLobes
+{
+    RixBXLobeSampled reflBlinnLobe;
+    RixBXLobeSampled reflMirrorLobe; // discrete, near-specular mode
+
+    RixBXLobeTraits reflBlinnLobeTraits;
+    RixBXLobeTraits reflMirrorLobeTraits;
+    RixBXLobeTraits reflLobeTraits; // union of the two above
+};
 
-static RixBXLobeTraits s_reflBlinnLobeTraits;
+enum paramIds
+{
+    k_color,
+    k_width,
+    k_mirrorWidth,
+    k_mirrorBand,
+    k_samplingMode,
+    k_rouletteThreshold,
+    k_presence,
+    k_transparency,
+    k_distribution,
+    k_simplifyIndirect,
+    k_simplifySpread,
+    k_reversePdf,
+    k_numParams
+};
 
-class PxrBeckmann : public RixBsdf
+class PxrBeckmann : public PxrBeckmannBsdf
 {
 public:
 
     PxrBeckmann(RixShadingContext const *sc, RixBxdfFactory *bx,
                RixBXLobeTraits const &lobesWanted,
-               RtColorRGB const *color, RtFloat const *width) :
-        RixBsdf(sc, bx),
+               RtColorRGB const *color, RtColorRGB const *colorDflt,
+               RtFloat const *width, RtFloat const *widthDflt,
+               RtFloat mirrorWidth, RtFloat mirrorBand,
+               RtInt samplingMode, RtInt distribution,
+               PxrBeckmannAlbedoTable const *albedoTable,
+               RtFloat rouletteThreshold,
+               bool simplifyAll, RtFloat simplifySpread,
+               bool reverse,
+               PxrBeckmannLobes const *lobes,
+               PxrBeckmannKernelTable const *kernels,
+               PxrBeckmannCaptureWriter *capture) :
+        PxrBeckmannBsdf(sc, bx),
+        m_lobes(lobes),
         m_lobesWanted(lobesWanted),
         m_color(color),
-        m_width(width)
+        m_width(width),
+        m_colorDflt(colorDflt),
+        m_widthDflt(widthDflt),
+        m_colorMask(color ? 0 : ~0),
+        m_widthMask(width ? 0 : ~0),
+        m_mirrorWidth(mirrorWidth),
+        m_mirrorBand(mirrorBand),
+        m_samplingMode(samplingMode),
+        m_distribution(distribution),
+        m_albedoTable(albedoTable),
+        m_rouletteThreshold(rouletteThreshold),
+        m_simplifyAll(simplifyAll),
+        m_simplifySpread(simplifySpread),
+        m_reverse(reverse),
+        m_kernels(kernels),
+        m_capture(capture),
+        m_haveView(false),
+        m_haveBasis(false)
     {
-        RixBXLobeTraits lobes = s_reflBlinnLobeTraits;
-
-        m_lobesWanted &= lobes;
+        m_lobesWanted &= m_lobes->reflLobeTraits;
 
         sc->GetBuiltinVar(RixShadingContext::k_P, &m_P);
         sc->GetBuiltinVar(RixShadingContext::k_Nn, &m_Nn);
         sc->GetBuiltinVar(RixShadingContext::k_Ngn, &m_Ngn);
         sc->GetBuiltinVar(RixShadingContext::k_Tn, &m_Tn);
         sc->GetBuiltinVar(RixShadingContext::k_Vn, &m_Vn);
-
+#ifdef PXRBECKMANN_EAGER_PARAMS
+        // in BeginScatter, for renderers that don't keep the context
+        // valid for deferred evaluation, see colorParam
+        colorParam();
+        widthParam();
+#endif
     }
 
     virtual RixBXEvaluateDomain GetEvaluateDomain()
@@ -86,8 +159,34 @@ public:
         *t = m_lobesWanted;
     }
 
+    virtual void GetAlbedo(RtColorRGB *albedo)
+    {
+        if (!m_haveView)
+            computeViewTerms();
+        colorParam();
+        RtInt nPts = shadingCtx->numPts;
+        for(int i = 0; i < nPts; i++)
+        {
+            albedo[i] = colorAt(i) * lobeAlbedo(widthAt(i), m_view.NdV[i],
+                                                m_view.blend[i]);
+        }
+    }
+
+    virtual void GetConeAngle(RtFloat *coneAngle)
+    {
+        if (!m_haveView)
+            computeViewTerms();
+        RtInt nPts = shadingCtx->numPts;
+        for(int i = 0; i < nPts; i++)
+        {
+            coneAngle[i] = (m_view.blend[i] > 0.f) ?
+                beckmannConeAngle(m_distribution, widthAt(i), m_view.NdV[i]) :
+                0.f;
+        }
+    }
+
 #ifdef RENDERMAN21
-    virtual void GenerateSample(RixBXTransportTrait transportTrait,
+    virtual void GenerateSample(RixBXTransportTrait /* transportTrait */,
                                 RixBXLobeTraits const *lobesWanted,
                                 RixRNG *rng,
                                 RixBXLobeSampled *lobeSampled,
@@ -96,7 +195,7 @@ public:
                                 RtFloat *FPdf, RtFloat *RPdf,
                                 RtColorRGB* compTrans)
 #else
-    virtual void GenerateSample(RixBXTransportTrait transportTrait,
+    virtual void GenerateSample(RixBXTransportTrait /* transportTrait */,
                                 RixBXLobeTraits const *lobesWanted,
                                 RixRNG *rng,
                                 RixBXLobeSampled *lobeSampled,
@@ -106,109 +205,128 @@ public:
 #endif
     {
         RtInt nPts = shadingCtx->numPts;
-        RixBXLobeTraits all = GetAllLobeTraits();
+        PxrBeckmannScopedTimer timer(k_timeGenerate, nPts);
         RtFloat2 *xi = (RtFloat2 *) RixAlloca(sizeof(RtFloat2) * nPts);
         rng->DrawSamples2D(nPts,xi);
+        if (m_capture)
+            capture(k_captureGenerate, 0, nPts, xi, NULL, 0);
+        generate(1, lobesWanted, xi, lobeSampled, Ln, W, FPdf, RPdf);
+    }
 
-        RtColorRGB *reflDiffuseWgt = NULL;
-
-        RtNormal3 Nf;
+    virtual void GenerateSamples(int numSamples,
+                                 RixBXLobeTraits const *lobesWanted,
+                                 RixRNG *rng,
+                                 RixBXLobeSampled *lobeSampled,
+                                 RtVector3 *Ln,
+                                 RixBXLobeWeights &W,
+                                 RtFloat *FPdf, RtFloat *RPdf)
+    {
+        RtInt nPts = shadingCtx->numPts;
+        PxrBeckmannScopedTimer timer(k_timeGenerate, nPts * numSamples);
+        RtFloat2 *shift = (RtFloat2 *) RixAlloca(sizeof(RtFloat2) * nPts);
+        rng->DrawSamples2D(nPts, shift);
 
-        for(int i = 0; i < nPts; i++)
+        RixShadingContext::Allocator pool(shadingCtx);
+        RtFloat2 *xi = pool.AllocForBxdf<RtFloat2>(nPts * numSamples);
+        for(int k = 0; k < numSamples; k++)
         {
-            lobeSampled[i].SetValid(false);
-
-            RixBXLobeTraits lobes = (all & lobesWanted[i]);
-            bool doDiff = (lobes & s_reflBlinnLobeTraits).HasAny();
-
-            if (!reflDiffuseWgt && doDiff)
-                reflDiffuseWgt = W.AddActiveLobe(s_reflBlinnLobe);
-            if (doDiff)
-            {
-                // we generate samples on the (front) side of Vn since
-                // we have no translucence effects.
-                RtFloat NdV;
-                NdV = m_Nn[i].Dot(m_Vn[i]);
-                if(NdV >= 0.f)
-                {
-                    Nf = m_Nn[i];
-                }
-                else
-                {
-                    Nf = -m_Nn[i];
-                    NdV = -NdV;
-                }
-                if(NdV > k_minfacing)
-                {
-                    generate(NdV, Nf, m_Tn[i], m_color[i],m_width[i], xi[i],
-                             Ln[i],m_Vn[i], reflDiffuseWgt[i], FPdf[i], RPdf[i]);
-                    lobeSampled[i] = s_reflBlinnLobe;
-                }
-                // else invalid.. NullTrait
-            }
+            RtFloat2 *xik = xi + k * nPts;
+            for(int i = 0; i < nPts; i++)
+                beckmannLatticeSample(k, numSamples, shift[i].x, shift[i].y,
+                                      xik[i].x, xik[i].y);
+            if (m_capture)
+                capture(k_captureGenerate, 0, nPts, xik, NULL, 0);
         }
-
+        generate(numSamples, lobesWanted, xi, lobeSampled, Ln, W, FPdf, RPdf);
     }
 
 #ifdef RENDERMAN21
-    virtual void EvaluateSample(RixBXTransportTrait transportTrait,
+    virtual void EvaluateSample(RixBXTransportTrait /* transportTrait */,
                                 RixBXLobeTraits const *lobesWanted,
                                 RixRNG *rng,
                                 RixBXLobeTraits *lobesEvaluated,
                                 RtVector3 const *Ln, RixBXLobeWeights &W,
                                 RtFloat *FPdf, RtFloat *RPdf)
 #else
-    virtual void EvaluateSample(RixBXTransportTrait transportTrait,
+    virtual void EvaluateSample(RixBXTransportTrait /* transportTrait */,
                                 RixBXLobeTraits const *lobesWanted,
                                 RixBXLobeTraits *lobesEvaluated,
                                 RtVector3 const *Ln, RixBXLobeWeights &W,
                                 RtFloat *FPdf, RtFloat *RPdf)
 #endif
     {
-        RtNormal3 Nf;
         RtInt nPts = shadingCtx->numPts;
-        RixBXLobeTraits all = GetAllLobeTraits();
+        PxrBeckmannScopedTimer timer(k_timeEvaluate, nPts);
 
         RtColorRGB *reflDiffuseWgt = NULL;
+        PxrBeckmannStatTally tally;
+        tally.Add(k_statEvaluateCalls);
+        tally.Add(k_statEvaluatePoints, nPts);
+        if (m_capture)
+            capture(k_captureEvaluate, 0, nPts, NULL, Ln, nPts);
+        bool reverse = m_reverse;
+
+        if (!m_haveView)
+            computeViewTerms();
 
         for(int i = 0; i < nPts; i++)
-        {
             lobesEvaluated[i].SetNone();
-            RixBXLobeTraits lobes = (all & lobesWanted[i]);
-            bool doDiff = (lobes & s_reflBlinnLobeTraits).HasAny();
 
-            if (!reflDiffuseWgt && doDiff)
-                reflDiffuseWgt = W.AddActiveLobe(s_reflBlinnLobe);
-
-            if (doDiff)
+        int *active = (int *) RixAlloca(sizeof(int) * nPts);
+        bool wanted;
+        int nActive = activePoints(lobesWanted, m_lobes->reflBlinnLobeTraits,
+                                   active, wanted, tally);
+        if (wanted)
+            reflDiffuseWgt = W.AddActiveLobe(m_lobes->reflBlinnLobe);
+
+        // Drop light samples below the horizon and points that are all
+        // discrete mirror, which has nothing to evaluate, so the kernel
+        // only sees lanes that produce a result.
+        int nValid = 0;
+        int nBelow = 0;
+        for(int a = 0; a < nActive; a++)
+        {
+            int i = active[a];
+            int lit = m_view.Nf[i].Dot(Ln[i]) > 0.f;
+            int facets = m_view.blend[i] > 0.f;
+            if (lit && simplifiedAt(i))
             {
-                RtFloat NdV;
-                NdV = m_Nn[i].Dot(m_Vn[i]);
-                if(NdV >= 0.f)
-                    Nf = m_Nn[i];
-                else
-                {
-                    Nf = -m_Nn[i];
-                    NdV = -NdV;
-                }
-                if(NdV > k_minfacing)
-                {
-                    RtFloat NdL = Nf.Dot(Ln[i]);
-                    if(NdL > 0.f)
-                    {
-                        evaluate(NdV, NdL,Nf, m_color[i],m_width[i],Ln[i],m_Vn[i],
-                                 reflDiffuseWgt[i], FPdf[i], RPdf[i]);
-                        lobesEvaluated[i] |= s_reflBlinnLobeTraits;
-                    }
-                }
+                colorParam();
+                evaluateSimplified(i, Ln[i], reflDiffuseWgt[i], FPdf[i], RPdf[i],
+                                   reverse);
+                lobesEvaluated[i] |= m_lobes->reflBlinnLobeTraits;
+                continue;
             }
+            active[nValid] = i;
+            nValid += lit & facets;
+            nBelow += facets & !lit;
         }
+        tally.Add(k_statLightBelow, nBelow);
 
+        PxrBeckmannSoABlock block;
+        int n = 0;
 
+        for(int a = 0; a < nValid; a++)
+        {
+            int i = active[a];
+            gatherView(block, n, i);
+            block.Lx[n] = Ln[i].x;
+            block.Ly[n] = Ln[i].y;
+            block.Lz[n] = Ln[i].z;
+            if (++n == k_soaBlockSize)
+            {
+                flushEvaluate(block, n, lobesEvaluated, reflDiffuseWgt,
+                              FPdf, RPdf, reverse, tally);
+                n = 0;
+            }
+        }
+        if (n)
+            flushEvaluate(block, n, lobesEvaluated, reflDiffuseWgt, FPdf, RPdf,
+                          reverse, tally);
     }
 
 #ifdef RENDERMAN21
-    virtual void EvaluateSamplesAtIndex(RixBXTransportTrait transportTrait,
+    virtual void EvaluateSamplesAtIndex(RixBXTransportTrait /* transportTrait */,
                                             RixBXLobeTraits const &lobesWanted,
                                             RixRNG *rng,
                                             RtInt index, RtInt nsamps,
@@ -217,7 +335,7 @@ public:
                                             RixBXLobeWeights &W,
                                             RtFloat *FPdf, RtFloat *RPdf)
 #else
-    virtual void EvaluateSamplesAtIndex(RixBXTransportTrait transportTrait,
+    virtual void EvaluateSamplesAtIndex(RixBXTransportTrait /* transportTrait */,
                                         RixBXLobeTraits const &lobesWanted,
                                         RtInt index, RtInt nsamps,
                                         RixBXLobeTraits *lobesEvaluated,
@@ -226,211 +344,673 @@ public:
                                         RtFloat *FPdf, RtFloat *RPdf)
 #endif
     {
+        PxrBeckmannScopedTimer timer(k_timeEvaluateAtIndex, nsamps);
         for (int i = 0; i < nsamps; i++)
             lobesEvaluated[i].SetNone();
 
         RixBXLobeTraits lobes = lobesWanted & GetAllLobeTraits();
-        bool doDiff = (lobes & s_reflBlinnLobeTraits).HasAny();
+        bool doDiff = (lobes & m_lobes->reflBlinnLobeTraits).HasAny();
 
         if(!doDiff)
             return;
 
-        RtNormal3 const &Nn = m_Nn[index];
-        RtNormal3 const &Ngn = m_Ngn[index];
-        RtVector3 const &Vn = m_Vn[index];
-        RtColorRGB const &color = m_color[index];
-        RtFloat const &width = m_width[index];
+        PxrBeckmannStatTally tally;
+        tally.Add(k_statEvaluateAtIndexCalls);
+        tally.Add(k_statEvaluateAtIndexSamples, nsamps);
+        if (m_capture)
+            capture(k_captureEvaluateAtIndex, index, 1, NULL, Ln, nsamps);
+        bool reverse = m_reverse;
 
+        if (!m_haveView)
+            computeViewTerms();
 
         // Make any lobes that we may evaluate or write to active lobes,
         // initialize their lobe weights to zero and fetch a pointer to the
         // lobe weight arrays.
 
         RtColorRGB *reflDiffuseWgt = doDiff
-            ? W.AddActiveLobe(s_reflBlinnLobe) : NULL;
+            ? W.AddActiveLobe(m_lobes->reflBlinnLobe) : NULL;
 
-        RtNormal3 Nf;
-        RtFloat NdV;
-
-        NdV = Nn.Dot(Vn);
-        if(NdV >= .0f)
-            Nf = Nn;
-        else
+        if(m_view.NdV[index] <= k_minfacing)
         {
-            Nf = -Nn;
-            NdV = -NdV;
+            tally.Add(k_statMinFacing, nsamps);
+            return;
         }
-        RtFloat NfdV;
-        NfdV = NdV;
-        if(NdV > k_minfacing)
+        if(m_view.blend[index] <= 0.f)
+            return;
+
+        RtNormal3 const &Nf = m_view.Nf[index];
+        if(simplifiedAt(index))
         {
-            for(int i=0; i<nsamps; ++i)
+            for(int i = 0; i < nsamps; i++)
             {
-                RtFloat NdL = Nf.Dot(Ln[i]);
-                if(NdL > 0.f)
+                if(Nf.Dot(Ln[i]) <= 0.f)
                 {
-                    evaluate(NfdV, NdL,Nf, color,width,Ln[index],Vn,
-                             reflDiffuseWgt[i], FPdf[i], RPdf[i]);
-                    lobesEvaluated[i] |= s_reflBlinnLobeTraits;
+                    tally.Add(k_statLightBelow);
+                    continue;
                 }
+                colorParam();
+                evaluateSimplified(index, Ln[i], reflDiffuseWgt[i], FPdf[i],
+                                   RPdf[i], reverse);
+                lobesEvaluated[i] |= m_lobes->reflBlinnLobeTraits;
             }
+            return;
         }
+
+        // One point, many lights: the view side is gathered into the lanes
+        // once and only the light directions change from block to block.
+        // Samples below the horizon are dropped before the kernel.
+        PxrBeckmannSoABlock block;
+        int nLanes = std::min<int>(nsamps, k_soaBlockSize);
+        for(int k = 0; k < nLanes; k++)
+            gatherView(block, k, index);
+
+        int n = 0;
+        for(int i = 0; i < nsamps; i++)
+        {
+            if(Nf.Dot(Ln[i]) <= 0.f)
+            {
+                tally.Add(k_statLightBelow);
+                continue;
+            }
+            block.index[n] = i;
+            block.Lx[n] = Ln[i].x;
+            block.Ly[n] = Ln[i].y;
+            block.Lz[n] = Ln[i].z;
+            if (++n == k_soaBlockSize)
+            {
+                flushEvaluateAtIndex(block, n, index, lobesEvaluated,
+                                     reflDiffuseWgt, FPdf, RPdf, reverse,
+                                     tally);
+                n = 0;
+            }
+        }
+        if (n)
+            flushEvaluateAtIndex(block, n, index, lobesEvaluated,
+                                 reflDiffuseWgt, FPdf, RPdf, reverse, tally);
     }
 
 
 private:
 
-
-    PRMAN_INLINE
-    void generate(RtFloat NdV,
-                 const RtNormal3 &Nn, const RtVector3 &Tn,
-                 const RtColorRGB &color,
-                 const RtFloat &width,
-                 const RtFloat2 &xi,
-                 RtVector3 &Ln, RtVector3 const &inDir, RtColorRGB  &W,
-                 RtFloat &FPdf, RtFloat &RPdf)
-    {
-        RtVector3 TX, TY;
-        RixComputeShadingBasis(Nn, Tn, TX, TY);
-        // Compute our new direction
-        // half angle
-        float cosTheta = sqrtf(1.f/(1.f-(width*width*logf(1.f-xi.x))));
-//        float cosTheta = cos(atan(sqrtf(-(width*width*log(1.f-xi.x)))));
-        float cosThetaSqrd = cosTheta*cosTheta;
-        float sinTheta = sqrtf(fmax(0.f,1.f-cosThetaSqrd));
-        float tanSqrd = (sinTheta*sinTheta)/cosThetaSqrd;
-        float phi = xi.y * 2.f * M_PI;
-        float x = sinTheta*cosf(phi);
-        float y = sinTheta*sinf(phi);
-        float z = cosTheta;
-        RtVector3 m = x * TX + y * TY + z * Nn;
-        // scattered light direction
-        Ln = 2.f*inDir.AbsDot(m)*m-inDir;
-
-        RtVector3 wh = (Ln+inDir);
-        wh.Normalize();
-
-        //Beckmann NDF
-        float D;
-        if(cosTheta<=0.f)
-            D = 0.f;
+    // Fills the view dependent terms of every shading point into pool
+    // memory. The renderer calls GenerateSample, EvaluateSample and
+    // EvaluateSamplesAtIndex many times on the same object, so we do this
+    // once, on first use, and share the result between all of them.
+    void computeViewTerms()
+    {
+        widthParam();
+        if (m_widthMask)
+            computeViewTermsT<false>();
         else
-        {
-//            D = (1.f/(M_PI*width*width*cosThetaSqrd*cosThetaSqrd))*expf(-tanSqrd/(width*width));
-            D = (1.f/(M_PI*width*width*cosThetaSqrd*cosThetaSqrd))*expf((cosThetaSqrd-1.f)/(width*width*cosThetaSqrd));
+            computeViewTermsT<true>();
+        computeSimplified();
+    }
 
+    // Flags the points that swap the lobe for the simplified one, a cosine
+    // lobe carrying the lobe's tabulated albedo: all of them when the grid
+    // is simplified as a whole, else those whose incident ray has spread
+    // to at least m_simplifySpread, which grows with depth and with the
+    // roughness of the path so far. Pure mirror points are cheap already
+    // and stay as they are.
+    void computeSimplified()
+    {
+        m_view.simple = NULL;
+        if (!m_simplifyAll && m_simplifySpread <= 0.f)
+            return;
+        RtInt nPts = shadingCtx->numPts;
+        RtFloat const *spread = NULL;
+        if (!m_simplifyAll)
+            shadingCtx->GetBuiltinVar(RixShadingContext::k_incidentRaySpread,
+                                      &spread);
+        RixShadingContext::Allocator pool(shadingCtx);
+        m_view.simple = pool.AllocForBxdf<bool>(nPts);
+        int count = 0;
+        for(int i = 0; i < nPts; i++)
+        {
+            m_view.simple[i] = m_view.blend[i] > 0.f &&
+                               (m_simplifyAll || spread[i] >= m_simplifySpread);
+            count += m_view.simple[i];
         }
-        // Shadow function
-        float IdN = Nn.Dot(inDir);
-        float OdN = Nn.Dot(Ln);
-        float G1,G2;
-        if(IdN<=0.f)
-            G1 = 0.f;
-        else
+        PxrBeckmannStatTally tally;
+        tally.Add(k_statSimplifiedPoints, count);
+    }
+
+    // The simplified lobe of point i for light direction Ln, which must be
+    // above the horizon: the albedo times NdL / pi, sampled by its cosine.
+    void evaluateSimplified(int i, RtVector3 const &Ln, RtColorRGB &W,
+                            RtFloat &FPdf, RtFloat &RPdf, bool reverse) const
+    {
+        RtFloat NdL = m_view.Nf[i].Dot(Ln);
+        RtFloat albedo = lobeAlbedo(widthAt(i), m_view.NdV[i], m_view.blend[i]);
+        FPdf = NdL * (RtFloat) M_1_PI;
+        RPdf = reverse ? m_view.NdV[i] * (RtFloat) M_1_PI : 0.f;
+        W = colorAt(i) * (albedo * FPdf);
+    }
+
+    // With a uniform width the mirror blend is the same for every point and
+    // the width reads hoist out of the loop.
+    template <bool uniformWidth>
+    void computeViewTermsT()
+    {
+        RtInt nPts = shadingCtx->numPts;
+        RixShadingContext::Allocator pool(shadingCtx);
+        m_view.Nf = pool.AllocForBxdf<RtNormal3>(nPts);
+        m_view.NdV = pool.AllocForBxdf<RtFloat>(nPts);
+        m_view.blend = pool.AllocForBxdf<RtFloat>(nPts);
+        m_view.G1V = pool.AllocForBxdf<RtFloat>(nPts);
+        m_view.G1ExactV = pool.AllocForBxdf<RtFloat>(nPts);
+        m_view.invWidthSqrd = pool.AllocForBxdf<RtFloat>(nPts);
+        m_view.normD = pool.AllocForBxdf<RtFloat>(nPts);
+        PxrBeckmannStatTally tally;
+
+        RtFloat uniformBlend = uniformWidth ?
+            beckmannMirrorBlend(m_width[0], m_mirrorWidth, m_mirrorBand) : 0.f;
+
+        for(int i = 0; i < nPts; i++)
         {
-            float sinVSqrd = 1.f-IdN*IdN;
-            float tanV = sqrtf(sinVSqrd/(IdN*IdN));
-            float a = 1.f/(width*tanV);
-            if(a<1.6f)
+            RtFloat NdV = m_Nn[i].Dot(m_Vn[i]);
+            if(NdV >= 0.f)
+                m_view.Nf[i] = m_Nn[i];
+            else
             {
-                G1 = (3.535f*a+2.181f*a*a)/(1.f+2.276f*a+2.577f*a*a);
+                m_view.Nf[i] = -m_Nn[i];
+                NdV = -NdV;
             }
-            else
+            m_view.NdV[i] = NdV;
+            RtFloat width = uniformWidth ? m_width[0] : m_width[i];
+            m_view.blend[i] = uniformWidth ? uniformBlend :
+                beckmannMirrorBlend(width, m_mirrorWidth, m_mirrorBand);
+            beckmannViewTerms(m_samplingMode, NdV, width,
+                              m_view.G1V[i], m_view.G1ExactV[i],
+                              m_view.invWidthSqrd[i], m_view.normD[i],
+                              m_distribution);
+            if(m_view.G1V[i] <= 0.f)
+                tally.Add(k_statG1Zero);
+        }
+        m_haveView = true;
+    }
+
+    // GenerateSample(s) for numSamples sample major xi per point, see
+    // PxrBeckmannBsdf::GenerateSamples for the layout. Everything but the
+    // kernel itself is done once per point.
+    void generate(int numSamples, RixBXLobeTraits const *lobesWanted,
+                  RtFloat2 *xi, RixBXLobeSampled *lobeSampled, RtVector3 *Ln,
+                  RixBXLobeWeights &W, RtFloat *FPdf, RtFloat *RPdf)
+    {
+        RtInt nPts = shadingCtx->numPts;
+        RtInt nOut = nPts * numSamples;
+        PxrBeckmannStatTally tally;
+        tally.Add(k_statGenerateCalls);
+        tally.Add(k_statGeneratePoints, nOut);
+
+        bool reverse = m_reverse;
+
+        RtColorRGB *reflDiffuseWgt = NULL;
+        RtColorRGB *reflMirrorWgt = NULL;
+        RtFloat *continuation = (RtFloat *) RixAlloca(sizeof(RtFloat) * nPts);
+
+        if (!m_haveView)
+            computeViewTerms();
+
+        // invalid.. NullTrait, for everything the loop below skips
+        for(int o = 0; o < nOut; o++)
+            lobeSampled[o].SetValid(false);
+
+        // we generate samples on the (front) side of Vn since
+        // we have no translucence effects.
+        int *active = (int *) RixAlloca(sizeof(int) * nPts);
+        bool wanted, uniform;
+        int nActive = activePoints(lobesWanted, m_lobes->reflLobeTraits,
+                                   active, wanted, tally, &uniform);
+        if (!nActive)
+            return;
+        unsigned char *wants = (unsigned char *) RixAlloca(nPts);
+        if (wantedLobes(lobesWanted, uniform, wants) & k_wantBlinn)
+            reflDiffuseWgt = W.AddActiveLobe(m_lobes->reflBlinnLobe);
+        if (!m_haveBasis)
+            computeBasis();
+        colorParam();
+
+        // lane n of block writes its sample to output[n]
+        PxrBeckmannSoABlock block;
+        int output[k_soaBlockSize];
+        int n = 0;
+
+        for(int a = 0; a < nActive; a++)
+        {
+            int i = active[a];
+            RtFloat NdV = m_view.NdV[i];
+            RtFloat blend = m_view.blend[i];
+            RtFloat albedo = lobeAlbedo(widthAt(i), NdV, blend);
+            RtFloat q = continuationProbability(colorAt(i), albedo);
+            bool simple = simplifiedAt(i);
+            int want = wants[i];
+            RtVector3 const &TX = m_view.TX[i];
+            RtVector3 const &TY = m_view.TY[i];
+            RtFloat pMirror = 1.f - blend;
+            continuation[i] = q;
+
+            for(int k = 0; k < numSamples; k++)
             {
-                G1 = 1.f;
+                int o = k * nPts + i;
+
+                // Russian roulette on dark lobes: continue with probability
+                // q and reuse the rest of xi.x to sample the lobe itself.
+                if(q < 1.f)
+                {
+                    if(xi[o].x >= q)
+                    {
+                        tally.Add(k_statRouletteKilled);
+                        continue; // terminated.. NullTrait
+                    }
+                    xi[o].x /= q;
+                }
+
+                if(simple)
+                {
+                    // cosine lobe with the lobe's albedo, no kernel either
+                    if (!(want & k_wantBlinn))
+                        continue;
+                    RtFloat x, y, z;
+                    beckmannSampleCosine(xi[o].x, xi[o].y, x, y, z);
+                    Ln[o] = x * TX + y * TY + z * m_view.Nf[i];
+                    FPdf[o] = z * (RtFloat) M_1_PI;
+                    RPdf[o] = reverse ? NdV * (RtFloat) M_1_PI : 0.f;
+                    reflDiffuseWgt[o] = colorAt(i) * (albedo * FPdf[o] / q);
+                    lobeSampled[o] = m_lobes->reflBlinnLobe;
+                    continue;
+                }
+
+                // The mirror is picked here, with the same test as the
+                // kernel, so points that want only one of the two lobes
+                // neither get a sample of the other nor run the kernel for
+                // it. Only microfacet samples reach the kernel.
+                if(blend <= 0.f || xi[o].x < pMirror)
+                {
+                    if (want & k_wantMirror)
+                        generateMirror(i, o, std::min(pMirror, 1.f), q,
+                                       reverse, lobeSampled, Ln, W,
+                                       reflMirrorWgt, FPdf, RPdf, tally);
+                    continue;
+                }
+                if (!(want & k_wantBlinn))
+                    continue;
+
+                gatherView(block, n, i);
+                block.TXx[n] = TX.x; block.TXy[n] = TX.y; block.TXz[n] = TX.z;
+                block.TYx[n] = TY.x; block.TYy[n] = TY.y; block.TYz[n] = TY.z;
+                block.xi0[n] = xi[o].x;
+                block.xi1[n] = xi[o].y;
+                output[n] = o;
+                if (++n == k_soaBlockSize)
+                {
+                    flushGenerate(block, n, output, continuation, lobeSampled,
+                                  Ln, reflDiffuseWgt, FPdf, RPdf, reverse,
+                                  tally);
+                    n = 0;
+                }
             }
         }
-        if(OdN<=0.f)
-            G2 = 0.f;
-        else
+        if (n)
+            flushGenerate(block, n, output, continuation, lobeSampled, Ln,
+                          reflDiffuseWgt, FPdf, RPdf, reverse, tally);
+    }
+
+    // Pre-pass of GenerateSample and EvaluateSample. Writes the points that
+    // want lobe and face V to active, densely and in order, so the loops
+    // that follow only see work; the flip to face V is already folded into
+    // the view terms. wanted is set if any point asked for lobe at all.
+    // Usually every point wants the same lobes, then the trait test is done
+    // once rather than per point, and uniform, if given, is set.
+    int activePoints(RixBXLobeTraits const *lobesWanted,
+                     RixBXLobeTraits const &lobe, int *active, bool &wanted,
+                     PxrBeckmannStatTally &tally, bool *uniform = NULL)
+    {
+        RtInt nPts = shadingCtx->numPts;
+        RixBXLobeTraits all = GetAllLobeTraits();
+        int n = 0;
+        int nWanted = 0;
+
+        int same = 1;
+        while (same < nPts && lobesWanted[same] == lobesWanted[0])
+            ++same;
+        if (uniform)
+            *uniform = same >= nPts;
+
+        if (same >= nPts)
         {
-            float sinVSqrd = 1.f-OdN*OdN;
-            float tanV = sqrtf(sinVSqrd/(OdN*OdN));
-            float a = 1.f/(width*tanV);
-            if(a<1.6f)
+            if (nPts > 0 && (all & lobesWanted[0] & lobe).HasAny())
             {
-                G2 = (3.535f*a+2.181f*a*a)/(1.f+2.276f*a+2.577f*a*a);
+                nWanted = nPts;
+                for(int i = 0; i < nPts; i++)
+                {
+                    active[n] = i;
+                    n += (m_view.NdV[i] > k_minfacing);
+                }
             }
-            else
+        }
+        else
+        {
+            for(int i = 0; i < nPts; i++)
             {
-                G2 = 1.f;
+                int want = (all & lobesWanted[i] & lobe).HasAny();
+                nWanted += want;
+                active[n] = i;
+                n += want & (m_view.NdV[i] > k_minfacing);
             }
         }
-        //Blinn weight
-        float radiance = (G1*G2*D)/(4.f*IdN);
-        W = color * radiance;
-        FPdf = D * G1 / (4.f * IdN);
-        RPdf = D * G2 / (4.f * OdN);
+        tally.Add(k_statMinFacing, nWanted - n);
+        wanted = nWanted > 0;
+        return n;
+    }
+
+    // Fills wants with the k_wantBlinn and k_wantMirror bits of the lobes
+    // every point asked for, and returns them or'ed over all points. With
+    // uniform, as set by activePoints, the traits are tested once.
+    int wantedLobes(RixBXLobeTraits const *lobesWanted, bool uniform,
+                    unsigned char *wants)
+    {
+        RtInt nPts = shadingCtx->numPts;
+        RixBXLobeTraits all = GetAllLobeTraits();
+        int any = 0;
+        for(int i = 0; i < (uniform ? 1 : nPts); i++)
+        {
+            RixBXLobeTraits lobes = all & lobesWanted[i];
+            wants[i] = ((lobes & m_lobes->reflBlinnLobeTraits).HasAny() ?
+                        k_wantBlinn : 0) |
+                       ((lobes & m_lobes->reflMirrorLobeTraits).HasAny() ?
+                        k_wantMirror : 0);
+            any |= wants[i];
+        }
+        if (uniform)
+            std::memset(wants, wants[0], nPts);
+        return any;
+    }
+
+    // Writes the sample of the discrete mirror lobe of point i to output o,
+    // which was picked with probability pMirror, see beckmannGenerateBlockT,
+    // and continues with probability q.
+    void generateMirror(int i, int o, RtFloat pMirror, RtFloat q, bool reverse,
+                        RixBXLobeSampled *lobeSampled, RtVector3 *Ln,
+                        RixBXLobeWeights &W, RtColorRGB *&reflMirrorWgt,
+                        RtFloat *FPdf, RtFloat *RPdf,
+                        PxrBeckmannStatTally &tally)
+    {
+        if (!reflMirrorWgt)
+            reflMirrorWgt = W.AddActiveLobe(m_lobes->reflMirrorLobe);
+        Ln[o] = 2.f * m_view.NdV[i] * m_view.Nf[i] - m_Vn[i];
+        reflMirrorWgt[o] = colorAt(i) * (pMirror / q);
+        FPdf[o] = pMirror;
+        RPdf[o] = reverse ? pMirror : 0.f;
+        lobeSampled[o] = m_lobes->reflMirrorLobe;
+        tally.Add(k_statMirrorSamples);
+    }
 
+    // The shading basis is only needed to generate samples.
+    void computeBasis()
+    {
+        RtInt nPts = shadingCtx->numPts;
+        RixShadingContext::Allocator pool(shadingCtx);
+        m_view.TX = pool.AllocForBxdf<RtVector3>(nPts);
+        m_view.TY = pool.AllocForBxdf<RtVector3>(nPts);
+        for(int i = 0; i < nPts; i++)
+            RixComputeShadingBasis(m_view.Nf[i], m_Tn[i],
+                                   m_view.TX[i], m_view.TY[i]);
+        m_haveBasis = true;
+    }
+
+    // Varying color and width are evaluated on first use rather than in
+    // BeginScatter. Many grids never get that far: shadow and opacity
+    // traversals, grids rejected by the lobe traits or k_minfacing, and
+    // evaluates where every light is below the horizon. color, often the
+    // end of a texture network, is only needed for weights, so the pdf
+    // only paths don't pay for it at all.
+    //
+    // EvalParam is valid here for the same reason GetBuiltinVar is in
+    // computeSimplified: the integrator only calls this object between
+    // BeginScatter and EndScatter, on the thread that began it, and the
+    // shading context, its parameter list and the pool this object lives
+    // in all outlive that. The shading points don't change in between, so
+    // the result is what BeginScatter would have got, and it is kept in
+    // the same pool memory. Build with PXRBECKMANN_EAGER_PARAMS to
+    // evaluate them in BeginScatter instead.
+    void colorParam()
+    {
+        if (!m_color)
+            shadingCtx->EvalParam(k_color, -1, &m_color, m_colorDflt, true);
+    }
+
+    void widthParam()
+    {
+        if (!m_width)
+            shadingCtx->EvalParam(k_width, -1, &m_width, m_widthDflt, true);
     }
 
+    // Uniform (constant) parameters are a single value rather than an array,
+    // masking the index with 0 reads that value for every point.
     PRMAN_INLINE
-    void evaluate(RtFloat NdV, RtFloat NdL, RtNormal3 &Nn, const RtColorRGB &color, const RtFloat &width,
-                 RtVector3 Ln, RtVector3 const &inDir,
-                 RtColorRGB  &W, RtFloat &FPdf, RtFloat &RPdf)
-    {
-        //Compute our blinn weighting and PDF
-        //PDF
-        RtVector3 m = Ln + inDir;
-        m.Normalize();
-        float cosTheta = fabs(m.Dot(Nn));
-        float cosThetaSqrd = cosTheta*cosTheta;
-        float sinTheta = sqrtf(fmax(0.f,1.f-cosThetaSqrd));
-        float tanSqrd = (sinTheta*sinTheta)/cosThetaSqrd;
-
-        //Beckmann NDF
-        float D;
-        if(cosTheta<=0.f)
-            D = 0.f;
-        else
-            D = (1.f/(M_PI*width*width*cosThetaSqrd*cosThetaSqrd))*expf(-tanSqrd/(width*width));
-
-        // Shadow function
-        float IdN = Nn.Dot(inDir);
-        float OdN = Nn.Dot(Ln);
-        float G1,G2;
-        if(IdN<=0.f)
-            G1 = 0.f;
-        else
+    RtColorRGB const &colorAt(int i) const { return m_color[i & m_colorMask]; }
+    PRMAN_INLINE
+    RtFloat widthAt(int i) const { return m_width[i & m_widthMask]; }
+
+    bool simplifiedAt(int i) const { return m_view.simple && m_view.simple[i]; }
+
+    // Appends the inputs of numPts points from first, and xi or numSamples
+    // Ln, to the capture file. Uniform parameters are written once per point
+    // so the records don't depend on how the instance was bound.
+    void capture(PxrBeckmannCaptureType type, int first, int numPts,
+                 RtFloat2 const *xi, RtVector3 const *Ln, int numSamples)
+    {
+        colorParam();
+        widthParam();
+        PxrBeckmannCaptureWriter::Record r(type, numPts, numSamples, first,
+                                           m_samplingMode, m_distribution,
+                                           m_mirrorWidth, m_mirrorBand);
+        r.Add((float const *) (m_Nn + first), numPts, 3);
+        r.Add((float const *) (m_Ngn + first), numPts, 3);
+        r.Add((float const *) (m_Tn + first), numPts, 3);
+        r.Add((float const *) (m_Vn + first), numPts, 3);
+        r.Add((float const *) &colorAt(first), numPts, 3, m_colorMask & 1);
+        r.Add(&m_width[first & m_widthMask], numPts, 1, m_widthMask & 1);
+        if (xi)
+            r.Add((float const *) xi, numPts, 2);
+        if (Ln)
+            r.Add((float const *) Ln, numSamples, 3);
+        m_capture->Write(r);
+    }
+
+    // Copies the view side of shading point i into lane n of b.
+    PRMAN_INLINE
+    void gatherView(PxrBeckmannSoABlock &b, int n, int i) const
+    {
+        b.index[n] = i;
+        b.Nx[n] = m_view.Nf[i].x;
+        b.Ny[n] = m_view.Nf[i].y;
+        b.Nz[n] = m_view.Nf[i].z;
+        b.Vx[n] = m_Vn[i].x;
+        b.Vy[n] = m_Vn[i].y;
+        b.Vz[n] = m_Vn[i].z;
+        b.NdV[n] = m_view.NdV[i];
+        b.width[n] = widthAt(i);
+        b.blend[n] = m_view.blend[i];
+        b.G1V[n] = m_view.G1V[i];
+        b.G1ExactV[n] = m_view.G1ExactV[i];
+        b.invWidthSqrd[n] = m_view.invWidthSqrd[i];
+        b.normD[n] = m_view.normD[i];
+    }
+
+    // Albedo of the mirror/microfacet blend for a white color.
+    PRMAN_INLINE
+    RtFloat lobeAlbedo(RtFloat width, RtFloat NdV, RtFloat blend) const
+    {
+        return (1.f - blend) + blend * m_albedoTable->Lookup(width, NdV);
+    }
+
+    // Probability of continuing a path through a lobe of the given albedo.
+    // Lobes reflecting less than rouletteThreshold of the incoming energy
+    // are continued proportionally less often.
+    PRMAN_INLINE
+    RtFloat continuationProbability(RtColorRGB const &color, RtFloat albedo) const
+    {
+        if(m_rouletteThreshold <= 0.f)
+            return 1.f;
+        RtFloat maxAlbedo = albedo * std::max(color.r, std::max(color.g, color.b));
+        return std::min(1.f, maxAlbedo / m_rouletteThreshold);
+    }
+
+    // Runs the generate kernel over a gathered block and scatters the
+    // unmasked lanes back into the renderer's arrays, lane k to output[k],
+    // dividing weights by the russian roulette continuation probability of
+    // their point. The lanes all sample the microfacet lobe, generate has
+    // taken the mirror ones out.
+    void flushGenerate(PxrBeckmannSoABlock &b, int n, int const *output,
+                       RtFloat const *continuation,
+                       RixBXLobeSampled *lobeSampled, RtVector3 *Ln,
+                       RtColorRGB *reflDiffuseWgt,
+                       RtFloat *FPdf, RtFloat *RPdf, bool reverse,
+                       PxrBeckmannStatTally &tally)
+    {
+        m_kernels->generate(b, n, m_samplingMode, m_distribution, reverse);
+        for (int k = 0; k < n; ++k)
         {
-            float sinVSqrd = 1.f-IdN*IdN;
-            float tanV = sqrtf(sinVSqrd/(IdN*IdN));
-            float a = 1.f/(width*tanV);
-            if(a<1.6f)
+            if (!b.valid[k])
             {
-                G1 = (3.535f*a+2.181f*a*a)/(1.f+2.276f*a+2.577f*a*a);
-            }
-            else
-            {
-                G1 = 1.f;
+                tally.Add(k_statBackfacingNormal);
+                continue; // else invalid.. NullTrait
             }
+            int i = b.index[k];
+            int o = output[k];
+            Ln[o] = RtVector3(b.Lx[k], b.Ly[k], b.Lz[k]);
+            FPdf[o] = b.FPdf[k];
+            RPdf[o] = b.RPdf[k];
+            reflDiffuseWgt[o] = colorAt(i) * (b.radiance[k] / continuation[i]);
+            lobeSampled[o] = m_lobes->reflBlinnLobe;
+#ifdef PXRBECKMANN_STATS
+            RtFloat NdL = b.Nx[k]*b.Lx[k] + b.Ny[k]*b.Ly[k] + b.Nz[k]*b.Lz[k];
+            countSample(tally, NdL, b.width[k], reflDiffuseWgt[o],
+                        FPdf[o], RPdf[o]);
+#endif
         }
-        if(OdN<=0.f)
-            G2 = 0.f;
-        else
+    }
+
+    // Runs the evaluate kernel over a gathered block and scatters the
+    // unmasked lanes back into the renderer's arrays.
+    void flushEvaluate(PxrBeckmannSoABlock &b, int n,
+                       RixBXLobeTraits *lobesEvaluated,
+                       RtColorRGB *W, RtFloat *FPdf, RtFloat *RPdf,
+                       bool reverse, PxrBeckmannStatTally &tally)
+    {
+        m_kernels->evaluate(b, n, m_samplingMode, m_distribution, reverse);
+        colorParam();
+        for (int k = 0; k < n; ++k)
         {
-            float sinVSqrd = 1.f-OdN*OdN;
-            float tanV = sqrtf(sinVSqrd/(OdN*OdN));
-            float a = 1.f/(width*tanV);
-            if(a<1.6f)
+            if (!b.valid[k])
             {
-                G2 = (3.535f*a+2.181f*a*a)/(1.f+2.276f*a+2.577f*a*a);
+                tally.Add(b.NdV[k] > k_minfacing ? k_statLightBelow
+                                                 : k_statMinFacing);
+                continue;
             }
-            else
+            int i = b.index[k];
+            W[i] = colorAt(i) * b.radiance[k];
+            FPdf[i] = b.FPdf[k];
+            RPdf[i] = b.RPdf[k];
+            lobesEvaluated[i] |= m_lobes->reflBlinnLobeTraits;
+#ifdef PXRBECKMANN_STATS
+            RtFloat NdL = b.Nx[k]*b.Lx[k] + b.Ny[k]*b.Ly[k] + b.Nz[k]*b.Lz[k];
+            countSample(tally, NdL, b.width[k], W[i], FPdf[i], RPdf[i]);
+#endif
+        }
+    }
+
+    // flushEvaluate for EvaluateSamplesAtIndex, where every lane is the
+    // same point and b.index holds the sample.
+    void flushEvaluateAtIndex(PxrBeckmannSoABlock &b, int n, int point,
+                              RixBXLobeTraits *lobesEvaluated,
+                              RtColorRGB *W, RtFloat *FPdf, RtFloat *RPdf,
+                              bool reverse, PxrBeckmannStatTally &tally)
+    {
+        m_kernels->evaluate(b, n, m_samplingMode, m_distribution, reverse);
+        colorParam();
+        RtColorRGB const &color = colorAt(point);
+        for (int k = 0; k < n; ++k)
+        {
+            if (!b.valid[k])
             {
-                G2 = 1.f;
+                tally.Add(k_statLightBelow);
+                continue;
             }
+            int i = b.index[k];
+            W[i] = color * b.radiance[k];
+            FPdf[i] = b.FPdf[k];
+            RPdf[i] = b.RPdf[k];
+            lobesEvaluated[i] |= m_lobes->reflBlinnLobeTraits;
+#ifdef PXRBECKMANN_STATS
+            RtFloat NdL = b.Nx[k]*b.Lx[k] + b.Ny[k]*b.Ly[k] + b.Nz[k]*b.Lz[k];
+            countSample(tally, NdL, b.width[k], W[i], FPdf[i], RPdf[i]);
+#endif
         }
-        //Blinn weight
-        float radiance = (G1*G2*D)/(4.f*IdN);
-        W = color * radiance;
-        FPdf = D * G1 / (4.f * IdN);
-        RPdf = D * G2 / (4.f * OdN);
     }
+
+#ifdef PXRBECKMANN_STATS
+    // Tallies the failure modes of one microfacet sample. The kernels do not
+    // keep G2 around, so it is recomputed here; only stats builds pay for it.
+    void countSample(PxrBeckmannStatTally &tally, RtFloat NdL, RtFloat width,
+                     RtColorRGB const &W, RtFloat FPdf, RtFloat RPdf) const
+    {
+        if(beckmannNdfG1(m_distribution, NdL, width) <= 0.f)
+            tally.Add(k_statG2Zero);
+        if(beckmannIsNonFinite(W.r) || beckmannIsNonFinite(W.g) ||
+           beckmannIsNonFinite(W.b) || beckmannIsNonFinite(FPdf) ||
+           beckmannIsNonFinite(RPdf))
+            tally.Add(k_statNonFinite);
+    }
+#endif
+
 private:
+    PxrBeckmannLobes const *m_lobes;
     RixBXLobeTraits m_lobesWanted;
-    RtColorRGB const *m_color;
+    RtColorRGB const *m_color; // NULL until evaluated, see colorParam
     RtFloat const *m_width;
+    RtColorRGB const *m_colorDflt;
+    RtFloat const *m_widthDflt;
+    int m_colorMask; // 0 for a uniform color, else ~0
+    int m_widthMask;
+    RtFloat m_mirrorWidth;
+    RtFloat m_mirrorBand;
+    RtInt m_samplingMode; // PxrBeckmannSamplingMode
+    RtInt m_distribution; // PxrBeckmannDistribution
+    PxrBeckmannAlbedoTable const *m_albedoTable;
+    RtFloat m_rouletteThreshold;
+    bool m_simplifyAll;       // every point uses the simplified lobe
+    RtFloat m_simplifySpread; // incident ray spread that simplifies, 0 off
+    // Whether RPdf is filled in, by the kernels and the mirror and
+    // simplified lobes alike. Bidirectional integrators (PxrVCM, PxrUPBP)
+    // weigh the light paths through the lobe with it, including those
+    // connected by direct lighting calls, and the transport trait doesn't
+    // say which integrator is asking, so it is on unless the reversePdf
+    // parameter turns it off. That is only safe with unidirectional
+    // integrators (PxrPathTracer, PxrDirectLighting), which never read it.
+    bool m_reverse;
+    PxrBeckmannKernelTable const *m_kernels; // block kernels for this cpu
+    PxrBeckmannCaptureWriter *m_capture; // NULL unless capturing
+
+    // Per shading point view terms, see computeViewTerms
+    struct ViewTerms
+    {
+        RtNormal3 *Nf;         // Nn flipped to face Vn
+        RtFloat *NdV;
+        RtFloat *blend;        // microfacet share, beckmannMirrorBlend
+        RtFloat *G1V;
+        RtFloat *G1ExactV;
+        RtFloat *invWidthSqrd;
+        RtFloat *normD;
+        RtVector3 *TX, *TY;    // shading basis around Nf
+        bool *simple;          // NULL, or where the simplified lobe is used
+    };
+    ViewTerms m_view;
+    bool m_haveView;
+    bool m_haveBasis;
     RtPoint3 const* m_P;
     RtVector3 const* m_Vn;
     RtVector3 const* m_Tn;
@@ -467,7 +1047,26 @@ public:
                                   RtConstPointer instanceData);
     virtual void EndScatter(RixBsdf *);
 
+    virtual RixOpacity *BeginOpacity(RixShadingContext const *,
+                                     RixSCShadingMode,
+                                     RtConstPointer instanceData);
+    virtual void EndOpacity(RixOpacity *);
+
   private:
+#ifdef PXRBECKMANN_STATS
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Writes the summed per-thread counters to the RenderMan log, and as
+    /// JSON to $PXRBECKMANN_STATS_JSON if it is set
+    //----------------------------------------------------------------------------------------------------------------------
+    void reportStats(RixContext &ctx);
+#endif
+#ifdef PXRBECKMANN_TIMING
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Writes call count and p50/p90/p99 latency of every entry point and
+    /// grid size bucket to the RenderMan log
+    //----------------------------------------------------------------------------------------------------------------------
+    void reportTiming(RixContext &ctx);
+#endif
     // these hold the default (def) values
     //----------------------------------------------------------------------------------------------------------------------
     /// @brief Defualt colour of our beckmann BRDF
@@ -478,6 +1077,69 @@ public:
     //----------------------------------------------------------------------------------------------------------------------
     RtFloat m_widthDflt;
     //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Default width below which our lobe becomes a discrete mirror
+    //----------------------------------------------------------------------------------------------------------------------
+    RtFloat m_mirrorWidthDflt;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Default width of the mirror to microfacet transition band
+    //----------------------------------------------------------------------------------------------------------------------
+    RtFloat m_mirrorBandDflt;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Default half vector sampling strategy, see PxrBeckmannSamplingMode
+    //----------------------------------------------------------------------------------------------------------------------
+    RtInt m_samplingModeDflt;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Default microfacet distribution, see PxrBeckmannDistribution
+    //----------------------------------------------------------------------------------------------------------------------
+    RtInt m_distributionDflt;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Default albedo below which paths are russian rouletted
+    //----------------------------------------------------------------------------------------------------------------------
+    RtFloat m_rouletteThresholdDflt;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Default for simplifying the lobe on every non camera hit, 0 is off
+    //----------------------------------------------------------------------------------------------------------------------
+    RtInt m_simplifyIndirectDflt;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Default incident ray spread above which the lobe is simplified, 0 is off
+    //----------------------------------------------------------------------------------------------------------------------
+    RtFloat m_simplifySpreadDflt;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Default for filling in reverse pdfs, 0 leaves RPdf at 0
+    //----------------------------------------------------------------------------------------------------------------------
+    RtInt m_reversePdfDflt;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Default presence, 1 is fully present
+    //----------------------------------------------------------------------------------------------------------------------
+    RtFloat m_presenceDflt;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Default transparency, 0 is opaque
+    //----------------------------------------------------------------------------------------------------------------------
+    RtColorRGB m_transparencyDflt;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Directional albedo of our lobe for every distribution, attached in Init
+    /// to the entries held by m_tables
+    //----------------------------------------------------------------------------------------------------------------------
+    PxrBeckmannAlbedoTable m_albedoTable[k_numDistributions];
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Precomputed tables, mapped from a file shared by every process on the node
+    //----------------------------------------------------------------------------------------------------------------------
+    PxrBeckmannTables m_tables;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Our lobes, looked up at RenderBegin. Points at the cache line aligned
+    /// start of m_lobeStorage since new need not honour alignas before C++17
+    //----------------------------------------------------------------------------------------------------------------------
+    PxrBeckmannLobes *m_lobes;
+    unsigned char m_lobeStorage[sizeof(PxrBeckmannLobes) + alignof(PxrBeckmannLobes)];
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Block kernels for the widest ISA this cpu runs, chosen in Init
+    //----------------------------------------------------------------------------------------------------------------------
+    PxrBeckmannKernelTable const *m_kernels;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief Shading input capture, opened in Init when $PXRBECKMANN_CAPTURE is set
+    //----------------------------------------------------------------------------------------------------------------------
+    PxrBeckmannCaptureWriter *m_capture;
+    //----------------------------------------------------------------------------------------------------------------------
 
 };
 
@@ -496,10 +1158,27 @@ PxrBeckmannFactory::PxrBeckmannFactory()
 {
     m_colorDflt = RtColorRGB(.5f);
     m_widthDflt = 1.f;
+    m_mirrorWidthDflt = .005f;
+    m_mirrorBandDflt = .005f;
+    m_samplingModeDflt = k_sampleNdf;
+    m_distributionDflt = k_distBeckmann;
+    m_rouletteThresholdDflt = 0.f;
+    m_simplifyIndirectDflt = 0;
+    m_simplifySpreadDflt = 0.f;
+    m_reversePdfDflt = 1;
+    m_presenceDflt = 1.f;
+    m_transparencyDflt = RtColorRGB(0.f);
+    m_kernels = &beckmannKernelTable(k_isaBaseline);
+    m_capture = NULL;
+
+    uintptr_t storage = (uintptr_t) m_lobeStorage;
+    uintptr_t align = alignof(PxrBeckmannLobes);
+    m_lobes = new ((void *) ((storage + align - 1) & ~(align - 1))) PxrBeckmannLobes;
 }
 
 PxrBeckmannFactory::~PxrBeckmannFactory()
 {
+    m_lobes->~PxrBeckmannLobes();
 }
 
 // Init
@@ -509,6 +1188,55 @@ PxrBeckmannFactory::~PxrBeckmannFactory()
 int
 PxrBeckmannFactory::Init(RixContext &ctx, char const *pluginpath)
 {
+    RixMessages *msgs = (RixMessages *) ctx.GetRixInterface(k_RixMessages);
+
+    // Map the tables from $PXRBECKMANN_TABLES, or a file in a private
+    // directory under $TMPDIR, which the first process of the user on a
+    // node builds for the others.
+    char const *tables = getenv("PXRBECKMANN_TABLES");
+    std::string tablesPath = (tables && *tables) ? std::string(tables) :
+                                                   beckmannDefaultTablesPath();
+    PxrBeckmannTables::Source source = m_tables.Load(tablesPath.c_str());
+    for (int d = 0; d < k_numDistributions; ++d)
+        m_albedoTable[d].Attach(m_tables.AlbedoTable(d));
+    if (msgs)
+    {
+        if (source == PxrBeckmannTables::k_mapped)
+            msgs->Info("PxrBeckmann: mapped tables from %s", tablesPath.c_str());
+        else if (source == PxrBeckmannTables::k_rebuilt)
+            msgs->Info("PxrBeckmann: rebuilt tables in %s", tablesPath.c_str());
+        else if (tablesPath.empty())
+            msgs->Warning("PxrBeckmann: no private directory for the tables "
+                          "under $TMPDIR, using a private copy");
+        else
+            msgs->Warning("PxrBeckmann: can't write tables to %s, using a "
+                          "private copy", tablesPath.c_str());
+    }
+
+    // Pick the widest kernels the cpu runs, $PXRBECKMANN_ISA (baseline,
+    // sse4.2, avx2 or avx512) caps the choice for testing.
+    m_kernels = &beckmannKernelTable(beckmannSelectIsa(getenv("PXRBECKMANN_ISA")));
+    if (msgs)
+        msgs->Info("PxrBeckmann: using %s kernels", beckmannIsaName(m_kernels->isa));
+
+    // Opt in capture of every grid we shade, capped at
+    // $PXRBECKMANN_CAPTURE_MB (default 1024) megabytes.
+    char const *path = getenv("PXRBECKMANN_CAPTURE");
+    if (path && *path && !m_capture)
+    {
+        char const *mb = getenv("PXRBECKMANN_CAPTURE_MB");
+        uint64_t maxBytes = (uint64_t) ((mb && *mb) ? atoi(mb) : 1024) << 20;
+        m_capture = new PxrBeckmannCaptureWriter(path, maxBytes);
+        if (!m_capture->IsOpen())
+        {
+            if (msgs)
+                msgs->Warning("PxrBeckmann: can't write capture to %s", path);
+            delete m_capture;
+            m_capture = NULL;
+        }
+        else if (msgs)
+            msgs->Info("PxrBeckmann: capturing shading inputs to %s", path);
+    }
     return 0;
 }
 
@@ -522,21 +1250,159 @@ PxrBeckmannFactory::Synchronize(RixContext &ctx, RixSCSyncMsg syncMsg,
 {
     if (syncMsg == k_RixSCRenderBegin)
     {
-        s_reflBlinnLobe = RixBXLookupLobeByName(ctx, false, true, true, false,
-                                                  k_reflBlinnLobeId,
-                                                  "Specular");
-
-        s_reflBlinnLobeTraits = RixBXLobeTraits(s_reflBlinnLobe);
+        PxrBeckmannLobes &lobes = *m_lobes;
+        lobes.reflBlinnLobe = RixBXLookupLobeByName(ctx, false, true, true, false,
+                                                    k_reflBlinnLobeId,
+                                                    "Specular");
+
+        lobes.reflMirrorLobe = RixBXLookupLobeByName(ctx, true, true, true, false,
+                                                     k_reflMirrorLobeId,
+                                                     "Specular");
+
+        lobes.reflBlinnLobeTraits = RixBXLobeTraits(lobes.reflBlinnLobe);
+        lobes.reflMirrorLobeTraits = RixBXLobeTraits(lobes.reflMirrorLobe);
+        lobes.reflLobeTraits = lobes.reflBlinnLobeTraits;
+        lobes.reflLobeTraits |= lobes.reflMirrorLobeTraits;
+#ifdef PXRBECKMANN_STATS
+        PxrBeckmannStats::Reset();
+#endif
+#ifdef PXRBECKMANN_TIMING
+        PxrBeckmannTiming::Reset();
+#endif
      }
+    else if (syncMsg == k_RixSCRenderEnd)
+    {
+#ifdef PXRBECKMANN_STATS
+        reportStats(ctx);
+#endif
+#ifdef PXRBECKMANN_TIMING
+        reportTiming(ctx);
+#endif
+    }
 }
 
-enum paramIds
+#ifdef PXRBECKMANN_STATS
+void
+PxrBeckmannFactory::reportStats(RixContext &ctx)
 {
-    k_color,
-    k_width,
-    k_numParams
+    unsigned long long totals[k_numStats];
+    PxrBeckmannStats::Merge(totals);
+
+    RixMessages *msgs = (RixMessages *) ctx.GetRixInterface(k_RixMessages);
+    if (msgs)
+    {
+        for (int i = 0; i < k_numStats; ++i)
+            msgs->Info("PxrBeckmann stats: %-24s %llu", beckmannStatName(i),
+                       totals[i]);
+    }
+
+    char const *path = getenv("PXRBECKMANN_STATS_JSON");
+    if (path && *path)
+    {
+        FILE *f = fopen(path, "w");
+        if (!f)
+        {
+            if (msgs)
+                msgs->Warning("PxrBeckmann: can't write stats to %s", path);
+            return;
+        }
+        fprintf(f, "{\n");
+        for (int i = 0; i < k_numStats; ++i)
+            fprintf(f, "    \"%s\": %llu%s\n", beckmannStatName(i), totals[i],
+                    (i + 1 < k_numStats) ? "," : "");
+        fprintf(f, "}\n");
+        fclose(f);
+    }
+}
+#endif
+
+#ifdef PXRBECKMANN_TIMING
+void
+PxrBeckmannFactory::reportTiming(RixContext &ctx)
+{
+    RixMessages *msgs = (RixMessages *) ctx.GetRixInterface(k_RixMessages);
+    if (!msgs)
+        return;
+
+    static const int k_size = k_numTimers * k_timeSizeBuckets * k_timeNsBuckets;
+    unsigned long long *totals = new unsigned long long[k_size];
+    PxrBeckmannTiming::Merge(totals);
+
+    for (int t = 0; t < k_numTimers; ++t)
+    {
+        for (int s = 0; s < k_timeSizeBuckets; ++s)
+        {
+            unsigned long long const *histogram =
+                totals + beckmannTimeBucket(t, s, 0);
+            unsigned long long calls = 0;
+            for (int b = 0; b < k_timeNsBuckets; ++b)
+                calls += histogram[b];
+            if (!calls)
+                continue;
+            msgs->Info("PxrBeckmann timing: %-22s n=%-5d+ calls %-10llu "
+                       "p50 %lluns p90 %lluns p99 %lluns",
+                       beckmannTimerName(t), 1 << s, calls,
+                       beckmannHistogramPercentile(histogram, calls, .5),
+                       beckmannHistogramPercentile(histogram, calls, .9),
+                       beckmannHistogramPercentile(histogram, calls, .99));
+        }
+    }
+    delete [] totals;
+}
+#endif
+
+// Per instance data built by CreateInstanceData. Parameters with a plain
+// (unconnected) value, or no value at all, are constant over every grid the
+// instance shades; we fetch them here once instead of in every BeginScatter.
+struct PxrBeckmannInstanceData
+{
+    RtInt hints;      // RixBxdfFactory::InstanceHints
+    RtInt constants;  // bit (1 << paramId) set for params held below
+
+    RtColorRGB color;
+    RtFloat width;
+    RtFloat mirrorWidth;
+    RtFloat mirrorBand;
+    RtInt samplingMode;
+    RtFloat rouletteThreshold;
+    RtFloat presence;
+    RtColorRGB transparency;
+    RtInt distribution;
+    RtInt simplifyIndirect;
+    RtFloat simplifySpread;
+    RtInt reversePdf;
+
+    bool IsConstant(int paramId) const { return (constants >> paramId) & 1; }
+
+    static void Free(RtPointer data)
+    {
+        delete (PxrBeckmannInstanceData *) data;
+    }
 };
 
+// Fetches a parameter into value if it is constant for the instance.
+template <typename T>
+static bool
+instanceConstant(RixParameterList const *plist, int paramId, T const &dflt,
+                 T &value)
+{
+    RixSCType type;
+    RixSCConnectionInfo cinfo;
+    plist->GetParamInfo(paramId, &type, &cinfo);
+    if (cinfo == k_RixSCDefaultValue)
+    {
+        value = dflt;
+        return true;
+    }
+    if (cinfo == k_RixSCParameter)
+    {
+        value = dflt;
+        plist->EvalParam(paramId, -1, &value);
+        return true;
+    }
+    return false; // connected, evaluate per grid
+}
+
 RixSCParamInfo const *
 PxrBeckmannFactory::GetParamTable()
 {
@@ -545,34 +1411,96 @@ PxrBeckmannFactory::GetParamTable()
     {
         RixSCParamInfo("color", k_RixSCColor),
         RixSCParamInfo("width", k_RixSCFloat),
+        RixSCParamInfo("mirrorWidth", k_RixSCFloat),
+        RixSCParamInfo("mirrorBand", k_RixSCFloat),
+        RixSCParamInfo("samplingMode", k_RixSCInteger),
+        RixSCParamInfo("rouletteThreshold", k_RixSCFloat),
+        RixSCParamInfo("presence", k_RixSCFloat),
+        RixSCParamInfo("transparency", k_RixSCColor),
+        RixSCParamInfo("distribution", k_RixSCInteger),
+        RixSCParamInfo("simplifyIndirect", k_RixSCInteger),
+        RixSCParamInfo("simplifySpread", k_RixSCFloat),
+        RixSCParamInfo("reversePdf", k_RixSCInteger),
         RixSCParamInfo() // end of table
     };
     return &s_ptable[0];
 }
 
 // CreateInstanceData:
-//    analyze plist to determine our response to GetOpacityHints.
-//    Checks these inputs:
-//          transmissionBehavior (value),
-//          presence (networked)
+//    analyze plist to determine our response to GetOpacityHints, and
+//    cache every parameter that is constant for the instance.
 int
 PxrBeckmannFactory::CreateInstanceData(RixContext &ctx,
                                       char const *handle,
                                       RixParameterList const *plist,
                                       InstanceData *idata)
 {
-    RtUInt64 req = k_TriviallyOpaque;
-    idata->data = (void *) req; // no memory allocated, overload pointer
-    idata->freefunc = NULL;
+    PxrBeckmannInstanceData *inst = new PxrBeckmannInstanceData;
+    inst->hints = k_TriviallyOpaque;
+    inst->constants = 0;
+
+    if (instanceConstant(plist, k_color, m_colorDflt, inst->color))
+        inst->constants |= 1 << k_color;
+    if (instanceConstant(plist, k_width, m_widthDflt, inst->width))
+        inst->constants |= 1 << k_width;
+    if (instanceConstant(plist, k_mirrorWidth, m_mirrorWidthDflt, inst->mirrorWidth))
+        inst->constants |= 1 << k_mirrorWidth;
+    if (instanceConstant(plist, k_mirrorBand, m_mirrorBandDflt, inst->mirrorBand))
+        inst->constants |= 1 << k_mirrorBand;
+    if (instanceConstant(plist, k_samplingMode, m_samplingModeDflt, inst->samplingMode))
+        inst->constants |= 1 << k_samplingMode;
+    if (instanceConstant(plist, k_rouletteThreshold, m_rouletteThresholdDflt,
+                         inst->rouletteThreshold))
+        inst->constants |= 1 << k_rouletteThreshold;
+    if (instanceConstant(plist, k_distribution, m_distributionDflt, inst->distribution))
+        inst->constants |= 1 << k_distribution;
+    if (instanceConstant(plist, k_simplifyIndirect, m_simplifyIndirectDflt,
+                         inst->simplifyIndirect))
+        inst->constants |= 1 << k_simplifyIndirect;
+    if (instanceConstant(plist, k_simplifySpread, m_simplifySpreadDflt,
+                         inst->simplifySpread))
+        inst->constants |= 1 << k_simplifySpread;
+    if (instanceConstant(plist, k_reversePdf, m_reversePdfDflt, inst->reversePdf))
+        inst->constants |= 1 << k_reversePdf;
+
+    // Only ask the renderer for opacity when the surface can actually be
+    // see-through; constant values can be cached by the renderer.
+    bool constPresence = instanceConstant(plist, k_presence, m_presenceDflt,
+                                          inst->presence);
+    bool constTransparency = instanceConstant(plist, k_transparency,
+                                              m_transparencyDflt,
+                                              inst->transparency);
+    if (constPresence)
+        inst->constants |= 1 << k_presence;
+    if (constTransparency)
+        inst->constants |= 1 << k_transparency;
+
+    bool present = constPresence && inst->presence == 1.f;
+    bool opaque = constTransparency && inst->transparency.r == 0.f &&
+                  inst->transparency.g == 0.f && inst->transparency.b == 0.f;
+    if (!present)
+    {
+        // GetOpacity includes presence, so shadows need it too
+        inst->hints |= k_ComputesPresence | k_ComputesOpacity;
+        if (constPresence)
+            inst->hints |= k_PresenceCanBeCached;
+    }
+    if (!opaque)
+        inst->hints |= k_ComputesOpacity;
+    if ((!present || !opaque) && constPresence && constTransparency)
+        inst->hints |= k_OpacityCanBeCached;
+
+    idata->data = (void *) inst;
+    idata->freefunc = PxrBeckmannInstanceData::Free;
     return 0;
 }
 
 int
 PxrBeckmannFactory::GetInstanceHints(RtConstPointer instanceData) const
 {
-    // our instance data is the RixBxdfFactory::InstanceHints bitfield.
-    InstanceHints const &hints = (InstanceHints const&) instanceData;
-    return hints;
+    PxrBeckmannInstanceData const *inst =
+        (PxrBeckmannInstanceData const *) instanceData;
+    return inst ? inst->hints : k_TriviallyOpaque;
 }
 
 // Finalize:
@@ -581,24 +1509,99 @@ PxrBeckmannFactory::GetInstanceHints(RtConstPointer instanceData) const
 void
 PxrBeckmannFactory::Finalize(RixContext &)
 {
+    delete m_capture;
+    m_capture = NULL;
 }
 RixBsdf *
 PxrBeckmannFactory::BeginScatter(RixShadingContext const *sCtx,
                                 RixBXLobeTraits const &lobesWanted,
-                                RixSCShadingMode sm,
+                                RixSCShadingMode /* sm */,
                                 RtConstPointer instanceData)
 {
-    // Get all input data
-    RtColorRGB const * color;
-    RtFloat const * width;
-    sCtx->EvalParam(k_color, -1, &color, &m_colorDflt, true);
-    sCtx->EvalParam(k_width, -1, &width, &m_widthDflt, true);
+    PxrBeckmannScopedTimer timer(k_timeBeginScatter, sCtx->numPts);
+
+    PxrBeckmannInstanceData const *inst =
+        (PxrBeckmannInstanceData const *) instanceData;
+
+    // Constants come straight from the instance, varying color and width
+    // are left NULL for PxrBeckmann to evaluate if and when it needs them.
+    RtColorRGB const * color =
+        (inst && inst->IsConstant(k_color)) ? &inst->color : NULL;
+    RtFloat const * width =
+        (inst && inst->IsConstant(k_width)) ? &inst->width : NULL;
+
+    // uniform controls
+    RtFloat const * mirrorWidth = &m_mirrorWidthDflt;
+    RtFloat const * mirrorBand = &m_mirrorBandDflt;
+    RtInt const * samplingMode = &m_samplingModeDflt;
+    RtInt const * distribution = &m_distributionDflt;
+    RtFloat const * rouletteThreshold = &m_rouletteThresholdDflt;
+    RtInt const * simplifyIndirect = &m_simplifyIndirectDflt;
+    RtFloat const * simplifySpread = &m_simplifySpreadDflt;
+    RtInt const * reversePdf = &m_reversePdfDflt;
+    if (inst && inst->IsConstant(k_mirrorWidth))
+        mirrorWidth = &inst->mirrorWidth;
+    else
+        sCtx->EvalParam(k_mirrorWidth, -1, &mirrorWidth, &m_mirrorWidthDflt, false);
+    if (inst && inst->IsConstant(k_mirrorBand))
+        mirrorBand = &inst->mirrorBand;
+    else
+        sCtx->EvalParam(k_mirrorBand, -1, &mirrorBand, &m_mirrorBandDflt, false);
+    if (inst && inst->IsConstant(k_samplingMode))
+        samplingMode = &inst->samplingMode;
+    else
+        sCtx->EvalParam(k_samplingMode, -1, &samplingMode, &m_samplingModeDflt, false);
+    if (inst && inst->IsConstant(k_distribution))
+        distribution = &inst->distribution;
+    else
+        sCtx->EvalParam(k_distribution, -1, &distribution, &m_distributionDflt, false);
+    if (inst && inst->IsConstant(k_rouletteThreshold))
+        rouletteThreshold = &inst->rouletteThreshold;
+    else
+        sCtx->EvalParam(k_rouletteThreshold, -1, &rouletteThreshold,
+                        &m_rouletteThresholdDflt, false);
+    if (inst && inst->IsConstant(k_simplifyIndirect))
+        simplifyIndirect = &inst->simplifyIndirect;
+    else
+        sCtx->EvalParam(k_simplifyIndirect, -1, &simplifyIndirect,
+                        &m_simplifyIndirectDflt, false);
+    if (inst && inst->IsConstant(k_simplifySpread))
+        simplifySpread = &inst->simplifySpread;
+    else
+        sCtx->EvalParam(k_simplifySpread, -1, &simplifySpread,
+                        &m_simplifySpreadDflt, false);
+    if (inst && inst->IsConstant(k_reversePdf))
+        reversePdf = &inst->reversePdf;
+    else
+        sCtx->EvalParam(k_reversePdf, -1, &reversePdf, &m_reversePdfDflt, false);
+
+    // An approximation of depth: RIS does not give a BxDF its ray depth,
+    // and the shading context only tells camera hits apart from deeper
+    // ones. The spread of the incident ray stands in for depth and
+    // roughness beyond that, per point, so a deep bounce off sharp mirrors
+    // can keep the full lobe and a shallow one off a rough surface can
+    // lose it.
+    bool simplifyAll = *simplifyIndirect && !sCtx->scTraits.primaryHit;
+
+    // out of range values fall back to Beckmann
+    RtInt dist = (*distribution >= 0 && *distribution < k_numDistributions) ?
+                 *distribution : k_distBeckmann;
 
     RixShadingContext::Allocator pool(sCtx);
     void *mem = pool.AllocForBxdf<PxrBeckmann>(1);
 
     // Must use placement new to set up the vtable properly
-    PxrBeckmann *eval = new (mem) PxrBeckmann(sCtx, this, lobesWanted, color,width);
+    PxrBeckmann *eval = new (mem) PxrBeckmann(sCtx, this, lobesWanted,
+                                              color, &m_colorDflt,
+                                              width, &m_widthDflt,
+                                              *mirrorWidth, *mirrorBand,
+                                              *samplingMode, dist,
+                                              &m_albedoTable[dist],
+                                              *rouletteThreshold,
+                                              simplifyAll, *simplifySpread,
+                                              *reversePdf != 0,
+                                              m_lobes,
+                                              m_kernels, m_capture);
 
     return eval;
 }
@@ -607,3 +1610,50 @@ void
 PxrBeckmannFactory::EndScatter(RixBsdf *)
 {
 }
+
+// BeginOpacity:
+//  only called for instances whose hints ask for opacity or presence.
+//  Trivial values are passed as NULL so PxrSurfaceOpacity skips them.
+RixOpacity *
+PxrBeckmannFactory::BeginOpacity(RixShadingContext const *sCtx,
+                                 RixSCShadingMode /* sm */,
+                                 RtConstPointer instanceData)
+{
+    PxrBeckmannInstanceData const *inst =
+        (PxrBeckmannInstanceData const *) instanceData;
+    if (!inst || !(inst->hints & (k_ComputesPresence | k_ComputesOpacity)))
+        return NULL;
+
+    RtFloat const *presence = NULL;
+    bool presenceUniform = false;
+    if (inst->hints & k_ComputesPresence)
+    {
+        presenceUniform = inst->IsConstant(k_presence);
+        if (presenceUniform)
+            presence = &inst->presence;
+        else
+            sCtx->EvalParam(k_presence, -1, &presence, &m_presenceDflt, true);
+    }
+
+    RtColorRGB const *transparency = NULL;
+    bool transparencyUniform = inst->IsConstant(k_transparency);
+    if (transparencyUniform)
+    {
+        RtColorRGB const &t = inst->transparency;
+        if (t.r != 0.f || t.g != 0.f || t.b != 0.f)
+            transparency = &t;
+    }
+    else
+        sCtx->EvalParam(k_transparency, -1, &transparency,
+                        &m_transparencyDflt, true);
+
+    RixShadingContext::Allocator pool(sCtx);
+    void *mem = pool.AllocForBxdf<PxrSurfaceOpacity>(1);
+    return new (mem) PxrSurfaceOpacity(sCtx, this, presence, transparency,
+                                       presenceUniform, transparencyUniform);
+}
+
+void
+PxrBeckmannFactory::EndOpacity(RixOpacity *)
+{
+}